@@ -0,0 +1,124 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "audio.h"
+
+int audio_write(struct audioparam *ap, uint8_t *buf, int size)
+{
+	int sz = ap->frames * 2 * ap->channels;
+	int err, i;
+
+	for (i = 0; i < size; i += sz) {
+		snd_pcm_wait(ap->sp, -1);
+		err = snd_pcm_writei(ap->sp, &buf[i], ap->frames);
+		if (err == -EPIPE) {
+			/* EPIPE means underrun */
+			fprintf(stderr, "underrun occurred %d\n", i);
+			snd_pcm_prepare(ap->sp);
+		} else if (err < 0) {
+			fprintf(stderr, "error from writei: %s\n", snd_strerror(err));
+		} else if (err != (int)ap->frames) {
+			fprintf(stderr, "short write, write %d frames\n", err);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int audio_read(struct audioparam *ap, int16_t *buf)
+{
+	int err;
+
+	err = snd_pcm_readi(ap->sp, buf, ap->frames);
+	if (err == (int)ap->frames)
+		return 0;
+
+	if (err == -EPIPE) {
+		/* EPIPE means overrun, left to the caller to count */
+		snd_pcm_prepare(ap->sp);
+		return err;
+	} else if (err == -EAGAIN) {
+		return err;
+	} else if (err < 0) {
+		fprintf(stderr, "error from read: %s\n",
+			snd_strerror(err));
+	} else if (err != (int)ap->frames) {
+		fprintf(stderr, "short read, read %d frames\n", err);
+	}
+
+	return -1;
+}
+
+void audio_close(struct audioparam *ap)
+{
+	snd_pcm_drain(ap->sp);
+	snd_pcm_close(ap->sp);
+	if (ap->buf)
+		munmap(ap->buf, ap->buf_sz);
+}
+
+int audio_open(struct audioparam *ap, int channels, uint32_t rate,
+	       uint32_t frames, int capture, int mmap_access)
+{
+	int err, dir;
+
+	err = snd_pcm_open(&ap->sp, "default", capture ? SND_PCM_STREAM_CAPTURE
+						       : SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		fprintf(stderr, "unable to open pcm device: %s\n",
+			snd_strerror(err));
+		return -1;
+	}
+
+	snd_pcm_hw_params_alloca(&ap->hwprm);
+	snd_pcm_hw_params_any(ap->sp, ap->hwprm);
+	ap->mmap = mmap_access &&
+		   !snd_pcm_hw_params_set_access(ap->sp, ap->hwprm,
+						 SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	if (mmap_access && !ap->mmap)
+		fprintf(stderr, "mmap access not supported, using read/write\n");
+	if (!ap->mmap)
+		snd_pcm_hw_params_set_access(ap->sp, ap->hwprm,
+					     SND_PCM_ACCESS_RW_INTERLEAVED);
+	snd_pcm_hw_params_set_format(ap->sp, ap->hwprm, SND_PCM_FORMAT_S16_LE);
+	snd_pcm_hw_params_set_channels(ap->sp, ap->hwprm, channels);
+	ap->rate = rate;
+	snd_pcm_hw_params_set_rate_near(ap->sp, ap->hwprm, &ap->rate, &dir);
+	ap->frames = frames;
+	snd_pcm_hw_params_set_period_size_near(ap->sp, ap->hwprm, &ap->frames,
+					       &dir);
+
+	err = snd_pcm_hw_params(ap->sp, ap->hwprm);
+	if (err < 0) {
+		fprintf(stderr, "unable to set hw parameters: %s\n",
+			snd_strerror(err));
+		snd_pcm_close(ap->sp);
+		return -1;
+	}
+
+	ap->channels = channels;
+	snd_pcm_hw_params_get_period_size(ap->hwprm, &ap->frames, &dir);
+	snd_pcm_hw_params_get_period_time(ap->hwprm, &ap->period_us, &dir);
+	/* the params were alloca()ed, don't hand them out */
+	ap->hwprm = NULL;
+
+	if (capture) {
+		/* 2bytes/sample * channels */
+		ap->buf_sz = ap->frames * 2 * ap->channels;
+		ap->buf = mmap(NULL, ap->buf_sz, PROT_READ | PROT_WRITE,
+			       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (ap->buf == MAP_FAILED) {
+			ap->buf = NULL;
+			snd_pcm_close(ap->sp);
+			return -1;
+		}
+	}
+
+	printf("rate:%d channels:%d frames:%d period:%dus buf_sz:%d%s\n",
+	       ap->rate, ap->channels, (int)ap->frames, ap->period_us,
+	       ap->buf_sz, ap->mmap ? " mmap" : "");
+	return 0;
+}
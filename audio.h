@@ -0,0 +1,32 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+
+#define ALSA_PCM_NEW_HW_PARAMS_API
+#include <alsa/asoundlib.h>
+
+/* S16_LE pcm on the ALSA "default" device */
+struct audioparam {
+	snd_pcm_t               *sp;
+	snd_pcm_hw_params_t     *hwprm;
+	snd_pcm_uframes_t       frames;
+	uint32_t                rate;
+	uint32_t                period_us;
+	int                     channels;
+	char                    *buf;
+	uint32_t                buf_sz;
+	int                     mmap;		/* MMAP_INTERLEAVED access */
+};
+
+int audio_open(struct audioparam *ap, int channels, uint32_t rate,
+	       uint32_t frames, int capture, int mmap_access);
+void audio_close(struct audioparam *ap);
+
+/* one period; -EPIPE after an overrun has been recovered */
+int audio_read(struct audioparam *ap, int16_t *buf);
+int audio_write(struct audioparam *ap, uint8_t *buf, int size);
+
+#endif /* AUDIO_H */
@@ -0,0 +1,207 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "bands.h"
+
+#define MIN(x, y)	(((x) < (y)) ? (x) : (y))
+#define CLAMP(v, lo, hi)	((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v))
+
+/* compressed rows: band i has weights w[start[i], start[i + 1]) */
+struct bands {
+	int n;
+	float *center;
+	int *start;
+	int *bin;
+	float *w;
+	int nnz, cap;
+};
+
+static const char *scale_names[] = {
+	[SCALE_LINEAR]	= "linear",
+	[SCALE_LOG]	= "log",
+	[SCALE_MEL]	= "mel",
+	[SCALE_CQT]	= "cqt",
+};
+
+const char *scale_name(int scale)
+{
+	return scale_names[scale];
+}
+
+static float to_scale(int scale, float f)
+{
+	switch (scale) {
+	case SCALE_LOG:
+	case SCALE_CQT:
+		return log2f(f);
+	case SCALE_MEL:
+		return 2595.0f * log10f(1.0f + f / 700.0f);
+	}
+	return f;
+}
+
+static float from_scale(int scale, float v)
+{
+	switch (scale) {
+	case SCALE_LOG:
+	case SCALE_CQT:
+		return exp2f(v);
+	case SCALE_MEL:
+		return 700.0f * (powf(10.0f, v / 2595.0f) - 1.0f);
+	}
+	return v;
+}
+
+float scale_pos(int scale, float f, float fmin, float fmax)
+{
+	float lo = to_scale(scale, fmin);
+
+	return (to_scale(scale, f) - lo) / (to_scale(scale, fmax) - lo);
+}
+
+static int push(struct bands *b, int bin, float w)
+{
+	void *p;
+
+	if (b->nnz == b->cap) {
+		b->cap = b->cap ? 2 * b->cap : 256;
+		p = realloc(b->bin, sizeof(*b->bin) * b->cap);
+		if (!p)
+			return -1;
+		b->bin = p;
+		p = realloc(b->w, sizeof(*b->w) * b->cap);
+		if (!p)
+			return -1;
+		b->w = p;
+	}
+	b->bin[b->nnz] = bin;
+	b->w[b->nnz++] = w;
+	return 0;
+}
+
+/* a triangle or a Hann window from lo through c to hi, in Hz */
+static int add_band(struct bands *b, int i, float c, float lo, float hi,
+		    int hann, float hz, int last)
+{
+	int k, k0 = (int)CLAMP(ceilf(lo / hz), 0, last);
+	int k1 = (int)CLAMP(floorf(hi / hz), 0, last);
+	float f, t, w, sum = 0.0f, p;
+
+	b->start[i] = b->nnz;
+	for (k = k0; k <= k1; k++) {
+		f = k * hz;
+		t = f < c ? (c - f) / (c - lo) : (f - c) / (hi - c);
+		if (t >= 1.0f)
+			continue;
+		w = hann ? 0.5f + 0.5f * cosf((float)M_PI * t) : 1.0f - t;
+		if (push(b, k, w))
+			return -1;
+		sum += w;
+	}
+
+	/* narrower than a bin, interpolate instead */
+	if (b->nnz == b->start[i]) {
+		p = c / hz;
+		k = (int)CLAMP(floorf(p), 0, last - 1);
+		p -= k;
+		if (push(b, k, 1.0f - p) || push(b, k + 1, p))
+			return -1;
+		sum = 1.0f;
+	}
+
+	for (k = b->start[i]; k < b->nnz; k++)
+		b->w[k] /= sum;
+	return 0;
+}
+
+struct bands *bands_create(int scale, int n, int size, int rate, float fmin,
+			   float fmax)
+{
+	float hz = (float)rate / size, lo, hi, step, c, q;
+	float per = CQT_PER_OCTAVE, oct = log2f(fmax / fmin);
+	int i, last = size / 2;
+	struct bands *b;
+
+	if (scale <= SCALE_LINEAR || scale >= SCALE_COUNT || fmin <= 0.0f ||
+	    fmax <= fmin || n <= 0)
+		return NULL;
+	/* never more bands than asked for, coarser when they would not fit */
+	if (scale == SCALE_CQT) {
+		if (per * oct > n)
+			per = n / oct;
+		n = MIN(n, (int)ceilf(per * oct));
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+	b->n = n;
+	b->center = malloc(sizeof(*b->center) * n);
+	b->start = malloc(sizeof(*b->start) * (n + 1));
+	if (!b->center || !b->start)
+		goto err;
+
+	lo = to_scale(scale, fmin);
+	hi = to_scale(scale, fmax);
+	step = (hi - lo) / n;
+	/* bandwidth over centre frequency, one band spacing either side */
+	q = exp2f(1.0f / per) - 1.0f;
+
+	for (i = 0; i < n; i++) {
+		if (scale == SCALE_CQT) {
+			c = fmin * exp2f(i / per);
+			if (add_band(b, i, c, c * (1.0f - q), c * (1.0f + q), 1,
+				     hz, last))
+				goto err;
+		} else {
+			/* centred in its share of the axis, edges at the neighbours */
+			c = from_scale(scale, lo + (i + 0.5f) * step);
+			if (add_band(b, i, c, from_scale(scale, lo + (i - 0.5f) * step),
+				     from_scale(scale, lo + (i + 1.5f) * step), 0,
+				     hz, last))
+				goto err;
+		}
+		b->center[i] = c;
+	}
+	b->start[n] = b->nnz;
+	return b;
+err:
+	bands_destroy(b);
+	return NULL;
+}
+
+void bands_destroy(struct bands *b)
+{
+	if (!b)
+		return;
+	free(b->center);
+	free(b->start);
+	free(b->bin);
+	free(b->w);
+	free(b);
+}
+
+int bands_count(struct bands *b)
+{
+	return b->n;
+}
+
+float bands_center(struct bands *b, int i)
+{
+	return b->center[i];
+}
+
+void bands_apply(struct bands *b, const float *mag, float *out)
+{
+	float s;
+	int i, k;
+
+	for (i = 0; i < b->n; i++) {
+		s = 0.0f;
+		for (k = b->start[i]; k < b->start[i + 1]; k++)
+			s += b->w[k] * mag[b->bin[k]];
+		out[i] = s;
+	}
+}
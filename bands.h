@@ -0,0 +1,42 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef BANDS_H
+#define BANDS_H
+
+/* frequency axes, the order 'f' cycles through them */
+enum {
+	SCALE_LINEAR,
+	SCALE_LOG,
+	SCALE_MEL,
+	SCALE_CQT,
+	SCALE_COUNT,
+};
+
+/* constant-Q resolution */
+#define CQT_PER_OCTAVE	24
+
+struct bands;
+
+/*
+ * Filterbank from the magnitude bins of a size point FFT at rate to bands
+ * between fmin and fmax: n triangles evenly spaced on the log or mel
+ * scale, or CQT_PER_OCTAVE constant-Q (Hann shaped, Q from the spacing)
+ * bands per octave, fewer when that would be more than n.  There are
+ * never more than n bands.  Bands narrower than a bin interpolate
+ * between the two bins around their centre.  The weights of a band sum
+ * to one and are kept as a sparse matrix, so bands_apply() is one pass
+ * over the non-zero weights.  LINEAR has no bands.
+ */
+struct bands *bands_create(int scale, int n, int size, int rate, float fmin,
+			   float fmax);
+void bands_destroy(struct bands *b);
+
+int bands_count(struct bands *b);
+float bands_center(struct bands *b, int i);
+void bands_apply(struct bands *b, const float *mag, float *out);
+
+/* where f falls on the scale between fmin and fmax, 0 to 1 */
+float scale_pos(int scale, float f, float fmin, float fmax);
+const char *scale_name(int scale);
+
+#endif /* BANDS_H */
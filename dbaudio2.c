@@ -1,279 +1,262 @@
 /* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
 
+#define _GNU_SOURCE		/* accept4() */
+
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
-#define ALSA_PCM_NEW_HW_PARAMS_API
-#include <alsa/asoundlib.h>
-
+#include "audio.h"
+#include "bands.h"
+#include "dsp.h"
 #include "dbx.h"
+#include "fft.h"
+#include "psd.h"
+#include "ring.h"
+#include "source.h"
+#include "stft.h"
+#include "waterfall.h"
+#include "wave.h"
 
 /******************************************************************************/
 
-typedef struct {
-	float Re, Im;
-} complex;
-
-void fft(complex *v, int n, complex *tmp)
-{
-	complex z, w, *vo, *ve;
-	int k, m;
-
-	if (n <= 1)
-		return;
-
-	ve = tmp;
-	vo = tmp + n / 2;
-	for (k = 0; k < n / 2; k++) {
-		ve[k] = v[2 * k];
-		vo[k] = v[2 * k + 1];
-	}
-
-	fft(ve, n / 2, v);
-	fft(vo, n / 2, v);
-
-	for (m = 0; m < n / 2; m++) {
-		w.Re =  cos(2 * M_PI * m / (double)n);
-		w.Im = -sin(2 * M_PI * m / (double)n);
-		z.Re = w.Re * vo[m].Re - w.Im * vo[m].Im;
-		z.Im = w.Re * vo[m].Im + w.Im * vo[m].Re;
-		v[m        ].Re = ve[m].Re + z.Re;
-		v[m        ].Im = ve[m].Im + z.Im;
-		v[m + n / 2].Re = ve[m].Re - z.Re;
-		v[m + n / 2].Im = ve[m].Im - z.Im;
-	}
-}
-
-#if 0
-void _ifft(complex *v, int n, complex *tmp)
+int _random(int min, int max)
 {
-	complex z, w, *vo, *ve;
-	int k, m;
-
-	if (n <= 1)
-		return;
+	static int once;
 
-	ve = tmp;
-	vo = tmp + n / 2;
-	for (k = 0; k < n / 2; k++) {
-		ve[k] = v[2 * k];
-		vo[k] = v[2 * k + 1];
+	if (!once) {
+		srand(0);
+		once = 1;
 	}
 
-	_ifft(ve, n / 2, v);
-	_ifft(vo, n / 2, v);
-
-	for (m = 0; m < n / 2; m++) {
-		w.Re = cos(2 * M_PI * m / (double)n);
-		w.Im = sin(2 * M_PI * m / (double)n);
-		z.Re = w.Re * vo[m].Re - w.Im * vo[m].Im;
-		z.Im = w.Re * vo[m].Im + w.Im * vo[m].Re;
-		v[m        ].Re = ve[m].Re + z.Re;
-		v[m        ].Im = ve[m].Im + z.Im;
-		v[m + n / 2].Re = ve[m].Re - z.Re;
-		v[m + n / 2].Im = ve[m].Im - z.Im;
-	}
+	return (int)transform(0, RAND_MAX, rand(), min, max);
 }
 
-void ifft(complex *v, int n, complex *tmp)
-{
-	int i;
-
-	_ifft(v, n, tmp);
-	for (i = 0; i < n; i++) {
-		v[i].Re /= n;
-		v[i].Im /= n;
-	}
-}
-#endif
+struct audioparam g_out_ap;
 
-//#define NO_FFT
-#ifdef NO_FFT
+/*
+ * Captured periods go through an SPSC ring to the main loop, which is woken
+ * as soon as one is queued and drains whatever has arrived.  By default a
+ * capture thread owns the source and signals an eventfd, nothing on the
+ * render side can stall a blocking read; if the renderer falls behind far
+ * enough to fill the ring a live source's period is read and dropped so the
+ * device itself never overruns, and the drop is counted.  Files and synth
+ * block on a second eventfd instead, signalled whenever the main loop frees
+ * slots.  DBAUD_CAPTURE=poll reads a source that supports it (alsa) from
+ * the main loop instead, without the ring.
+ *
+ * With mmap access the polled loop hands the consumer samples straight out
+ * of the driver's buffer, the handoff to another thread would need a copy
+ * anyway, so mmap access implies the polled loop.
+ */
+#define CAPTURE_SLOTS	32
+
+struct capture {
+	struct source           *src;
+	struct ring             *ring;
+	pthread_t               tid;
+	int                     poll;		/* source polled by the main loop */
+	int                     efd;		/* thread -> main loop wakeup */
+	int                     sfd;		/* main loop -> thread, slots freed */
+	atomic_int              run;
+	atomic_int              eof;
+	atomic_ulong            periods;	/* periods committed to the ring */
+	atomic_ulong            drops;		/* periods lost to a full ring */
+	unsigned long           underruns;	/* redraws with no new frames */
+	unsigned long           consumed;	/* periods taken by the renderer */
+	int                     fresh;		/* frames consumed since redraw */
+	int                     part;		/* frames short of a period, polled */
+	unsigned long long      samples;	/* frames handed to consume */
+	s16                     *scratch;	/* target for dropped periods */
+	void                    (*consume)(const s16 *pcm, int frames);
+};
 
-#define FLOAT	float
-#define SIN	sinf
-#define COS	cosf
-#define POW	powf
+struct capture g_cap = { .efd = -1, .sfd = -1 };
 
-void complex_dft(int cnt, FLOAT *tre, FLOAT *tim, FLOAT *fre, FLOAT *fim)
+static void *capture_thread(void *param)
 {
-	FLOAT a = 2 * M_PI / (FLOAT) cnt;
-	FLOAT re, im;
-	int f, t;
-
-	memset(fre, 0, sizeof(*fre) * cnt);
-	memset(fim, 0, sizeof(*fim) * cnt);
+	struct capture *c = param;
+	eventfd_t v;
+	s16 *slot;
+	int ret;
+
+	while (c->run) {
+		slot = ring_write_slot(c->ring);
+		/* a file or synth waits for the renderer to free a slot */
+		if (!slot && !c->src->live) {
+			eventfd_read(c->sfd, &v);
+			continue;
+		}
 
-	for (f = 0; f < cnt; f++) {
-		for (t = 0; t < cnt; t++) {
-			re = COS(a * f * t);
-			im = -1.0 * SIN(a * f * t);
-			fre[f] += re * tre[t] - im * tim[t];
-			fim[f] += im * tre[t] + re * tim[t];
+		ret = source_read(c->src, slot ? slot : c->scratch);
+		if (ret > 0) {
+			c->eof = 1;
+			eventfd_write(c->efd, 1);
+			break;
+		}
+		if (ret < 0)
+			continue;
+		if (!slot) {
+			c->drops++;
+			continue;
 		}
+		ring_write_commit(c->ring);
+		c->periods++;
+		eventfd_write(c->efd, 1);
 	}
+	return NULL;
 }
 
-void complex_idft(int cnt, FLOAT *tre, FLOAT *tim, FLOAT *fre, FLOAT *fim)
+static void capture_consume(void *arg, const s16 *pcm, int frames)
 {
-	int i;
-
-	for (i = 0; i < cnt; i++)
-		fim[i] *= -1.0f;
-
-	complex_dft(cnt, fre, fim, tre, tim);
-
-	for (i = 0; i < cnt; i++) {
-		tre[i] = tre[i] / (FLOAT)cnt;
-		tim[i] = tim[i] / (cnt * -1.0f);
-	}
+	struct capture *c = arg;
+	int n;
+
+	/* an mmap callback may hand over several periods, or part of one */
+	c->consume(pcm, frames);
+	c->samples += frames;
+	c->part += frames;
+	n = c->part / c->src->frames;
+	c->part -= n * c->src->frames;
+	c->periods += n;
+	c->consumed += n;
+	c->fresh += frames;
 }
-#endif /* NO_FFT */
 
-/******************************************************************************/
-
-int _random(int min, int max)
+static int capture_start(struct capture *c, struct source *src, int slots,
+			 int poll, void (*consume)(const s16 *, int))
 {
-	static int once;
-
-	if (!once) {
-		srand(0);
-		once = 1;
+	c->src = src;
+	c->consume = consume;
+	c->poll = poll;
+	if (poll && !source_can_poll(src)) {
+		printf("%s source can't be polled, using a capture thread\n",
+		       source_name(src));
+		c->poll = 0;
+	}
+	if (c->poll) {
+		printf("capture polled\n");
+		return 0;
 	}
 
-	return (int)transform(0, RAND_MAX, rand(), min, max);
-}
-
-struct audioparam {
-	snd_pcm_t               *sp;
-	snd_pcm_hw_params_t     *hwprm;
-	snd_pcm_uframes_t       frames;
-	u32                     rate;
-	u32                     period_us;
-	int                     channels;
-	char                    *buf;
-	u32                     buf_sz;
-};
-
-struct audioparam g_in_ap;
-struct audioparam g_out_ap;
-
-int audio_write(struct audioparam *ap, u8 *buf, int size)
-{
-	int sz = ap->frames * 2 * ap->channels;
-	int err, i;
-
-	for (i = 0; i < size; i += sz) {
-		snd_pcm_wait(ap->sp, -1);
-		err = snd_pcm_writei(ap->sp, &buf[i], ap->frames);
-		if (err == -EPIPE) {
-			/* EPIPE means underrun */
-			fprintf(stderr, "underrun occurred %d\n", i);
-			snd_pcm_prepare(ap->sp);
-		} else if (err < 0) {
-			fprintf(stderr, "error from writei: %s\n", snd_strerror(err));
-		} else if (err != (int)ap->frames) {
-			fprintf(stderr, "short write, write %d frames\n", err);
-			return -1;
-		}
+	c->ring = ring_create(sizeof(*c->scratch) * src->frames, slots);
+	c->scratch = malloc(sizeof(*c->scratch) * src->frames);
+	if (!c->ring || !c->scratch)
+		return -1;
+	c->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	c->sfd = eventfd(0, EFD_CLOEXEC);
+	if (c->efd < 0 || c->sfd < 0)
+		return -1;
+	c->run = 1;
+	if (pthread_create(&c->tid, NULL, capture_thread, c)) {
+		c->run = 0;
+		return -1;
 	}
+	printf("capture thread, ring: %d x %d bytes\n", ring_slots(c->ring),
+	       ring_slot_size(c->ring));
 	return 0;
 }
 
-static s16 *audio_read(struct audioparam *ap)
+static int capture_fds(struct capture *c, struct pollfd *pfd, int max)
 {
-	int err;
+	if (c->poll)
+		return source_poll_fds(c->src, pfd, max);
 
-	err = snd_pcm_readi(ap->sp, ap->buf, ap->frames);
-	if (err == (int)ap->frames)
-		return (s16 *)ap->buf;
-
-	if (err == -EPIPE) {
-		/* EPIPE means overrun */
-		fprintf(stderr, "overrun occurred\n");
-		snd_pcm_prepare(ap->sp);
-	} else if (err < 0) {
-		fprintf(stderr, "error from read: %s\n",
-			snd_strerror(err));
-	} else if (err != (int)ap->frames) {
-		fprintf(stderr, "short read, read %d frames\n", err);
-	}
-
-	return NULL;
+	pfd->fd = c->efd;
+	pfd->events = POLLIN;
+	return 1;
 }
 
-static void audio_close(struct audioparam *ap)
+/*
+ * Called when any capture descriptor is ready, consumes what arrived;
+ * -1 once a finite source has been played out.
+ */
+static int capture_ready(struct capture *c, struct pollfd *pfd, int n)
 {
-	snd_pcm_drain(ap->sp);
-	snd_pcm_close(ap->sp);
-	if (ap->buf)
-		munmap(ap->buf, ap->buf_sz);
-}
+	eventfd_t v;
+	s16 *slot;
+	int k, freed = 0;
 
-struct audioparam *audio_open(int channels, u32 rate, u32 frames, int capture)
-{
-	struct audioparam *ap = capture ? &g_in_ap : &g_out_ap;
-	int err, dir;
+	if (c->poll)
+		return source_poll_read(c->src, pfd, n, capture_consume, c);
 
-	err = snd_pcm_open(&ap->sp, "default", capture ? SND_PCM_STREAM_CAPTURE
-						       : SND_PCM_STREAM_PLAYBACK, 0);
-	if (err < 0) {
-		fprintf(stderr, "unable to open pcm device: %s\n",
-			snd_strerror(err));
-		return NULL;
+	eventfd_read(c->efd, &v);
+	/*
+	 * Only what was queued on entry: an unpaced source refills the ring
+	 * as fast as it drains and would keep the loop from redrawing.
+	 */
+	for (k = ring_count(c->ring); k > 0; k--) {
+		slot = ring_read_slot(c->ring);
+		if (!slot)
+			break;
+		c->consume(slot, c->src->frames);
+		ring_read_commit(c->ring);
+		c->samples += c->src->frames;
+		c->consumed++;
+		c->fresh += c->src->frames;
+		freed++;
 	}
-
-	snd_pcm_hw_params_alloca(&ap->hwprm);
-	snd_pcm_hw_params_any(ap->sp, ap->hwprm);
-	snd_pcm_hw_params_set_access(ap->sp, ap->hwprm,
-				     SND_PCM_ACCESS_RW_INTERLEAVED);
-	snd_pcm_hw_params_set_format(ap->sp, ap->hwprm, SND_PCM_FORMAT_S16_LE);
-	snd_pcm_hw_params_set_channels(ap->sp, ap->hwprm, channels);
-	ap->rate = rate;
-	snd_pcm_hw_params_set_rate_near(ap->sp, ap->hwprm, &ap->rate, &dir);
-	ap->frames = frames;
-	snd_pcm_hw_params_set_period_size_near(ap->sp, ap->hwprm, &ap->frames,
-					       &dir);
-
-	err = snd_pcm_hw_params(ap->sp, ap->hwprm);
-	if (err < 0) {
-		fprintf(stderr, "unable to set hw parameters: %s\n",
-			snd_strerror(err));
-		return NULL;
+	if (freed)
+		eventfd_write(c->sfd, 1);
+	/* the rest on the next wakeup, the source may have stopped writing */
+	if (ring_count(c->ring)) {
+		eventfd_write(c->efd, 1);
+		return 0;
+	}
+	if (c->eof) {
+		printf("end of input\n");
+		return -1;
 	}
+	return 0;
+}
 
-	ap->channels = channels;
-	snd_pcm_hw_params_get_period_size(ap->hwprm, &ap->frames, &dir);
-	snd_pcm_hw_params_get_period_time(ap->hwprm, &ap->period_us, &dir);
+static void capture_stats(struct capture *c)
+{
+	printf("capture periods:%lu consumed:%lu samples:%llu xruns:%lu"
+	       " drops:%lu underruns:%lu queued:%d\n",
+	       (unsigned long)c->periods, c->consumed, c->samples,
+	       (unsigned long)c->src->xruns, (unsigned long)c->drops,
+	       c->underruns, c->ring ? ring_count(c->ring) : 0);
+}
 
-	if (capture) {
-		/* 2bytes/sample * channels */
-		ap->buf_sz = ap->frames * 2 * ap->channels;
-		ap->buf = mmap(NULL, ap->buf_sz, PROT_READ | PROT_WRITE,
-			       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-		if (!ap->buf)
-			return NULL;
+static void capture_stop(struct capture *c)
+{
+	if (c->run) {
+		/* a blocking read returns within one period */
+		c->run = 0;
+		eventfd_write(c->sfd, 1);
+		pthread_join(c->tid, NULL);
 	}
-
-	printf("rate:%d channels:%d frames:%d period:%dus buf_sz:%d\n",
-	       rate, ap->channels, (int)ap->frames, ap->period_us, ap->buf_sz);
-	return ap;
+	if (c->efd >= 0)
+		close(c->efd);
+	if (c->sfd >= 0)
+		close(c->sfd);
+	if (c->src)
+		capture_stats(c);
+	ring_destroy(c->ring);
+	free(c->scratch);
 }
+
 /******************************************************************************/
 
 #define GREEN1	RGB(0x10, 0xa0, 0x10)
+#define AVG_COLOR	RGB(0xe0, 0xd0, 0x40)
+#define PEAK_COLOR	RGB(0x90, 0x30, 0x30)
 #define RED1	RGB(0xa0, 0x10, 0x10)
 #define BLUE1	RGB(0x30, 0x50, 0xff)
 
@@ -438,6 +421,41 @@ void tone_out(void)
 }
 
 int _pause;
+/* scope view, see display_scope() */
+static struct wave *g_wave;
+static int g_zoom;
+static int g_scope_len;
+static unsigned long long g_scope_end;	/* 0 follows the input */
+static int g_view_moved;		/* redraw even when paused */
+static int g_waterfall;			/* in place of the scope */
+static int g_scale;			/* spectrum axis, SCALE_* */
+static struct psd *g_psd;
+static int g_traces = 1;		/* average and peak hold drawn */
+
+static void scope_pan(int dir)
+{
+	unsigned long long head = wave_head(g_wave);
+	unsigned long long oldest = wave_oldest(g_wave) + g_scope_len;
+	unsigned long long end = g_scope_end ? g_scope_end : head;
+	int step = MAX(g_scope_len / 2, 1);
+
+	if (dir < 0)
+		end = end > oldest + step ? end - step : oldest;
+	else if (dir > 0)
+		end += step;
+	g_scope_end = dir && end < head ? end : 0;
+	g_view_moved = 1;
+}
+
+static void history_stats(void)
+{
+	float rate = g_cap.src->rate;
+
+	printf("history: %.1f of %.1f s, %.1f MiB, view %.3f s %s\n",
+	       (wave_head(g_wave) - wave_oldest(g_wave)) / rate,
+	       wave_size(g_wave) / rate, wave_bytes(g_wave) / 1048576.0,
+	       g_scope_len / rate, g_scope_end ? "panned" : "live");
+}
 
 static int key(struct dbx *d, int code, int key, int press)
 {
@@ -481,6 +499,65 @@ static int key(struct dbx *d, int code, int key, int press)
 			fg_n_bg = !fg_n_bg;
 		break;
 
+	case 'i':
+		if (press) {
+			capture_stats(&g_cap);
+			history_stats();
+		}
+		break;
+
+	case '=':
+	case '+':
+		if (press) {
+			g_zoom--;
+			g_view_moved = 1;
+		}
+		break;
+	case '-':
+		if (press) {
+			g_zoom++;
+			g_view_moved = 1;
+		}
+		break;
+	case 'f':
+		if (press) {
+			g_scale = (g_scale + 1) % SCALE_COUNT;
+			printf("spectrum: %s\n", scale_name(g_scale));
+			dbx_invalidate_background(d);
+			g_view_moved = 1;
+		}
+		break;
+	case 'w':
+		if (press) {
+			g_waterfall = !g_waterfall;
+			g_view_moved = 1;
+		}
+		break;
+	case 'a':
+		if (press) {
+			g_traces = !g_traces;
+			g_view_moved = 1;
+		}
+		break;
+	case 'z':
+		if (press) {
+			psd_reset(g_psd);
+			g_view_moved = 1;
+		}
+		break;
+	case '[':
+		if (press)
+			scope_pan(-1);
+		break;
+	case ']':
+		if (press)
+			scope_pan(1);
+		break;
+	case '\\':
+		if (press)
+			scope_pan(0);
+		break;
+
 /*
 	case '0':
 		if (press)
@@ -592,107 +669,366 @@ void random_color(u32 *c)
 	}
 }
 
-#ifdef NO_FFT
-float *do_dft(s16 *b, int count)
+#define FFT_SIZE	4096
+#define FFT_HOP		512
+/* seconds of scrollback */
+#define HISTORY_SEC	600
+
+struct stft *g_stft;
+
+static int env_int(const char *name, int def, int min, int max)
 {
-	static FLOAT *tre;
-	static FLOAT *tim;
-	static FLOAT *fre;
-	static FLOAT *fim;
-	int i;
+	char *s = getenv(name);
+	int v;
 
-	if (!tre) {
-		tre = malloc(sizeof(*tre) * count);
-		tim = malloc(sizeof(*tim) * count);
-		fre = malloc(sizeof(*fre) * count);
-		fim = malloc(sizeof(*fim) * count);
-	}
+	if (!s)
+		return def;
+	v = strtol(s, NULL, 0);
+	return v < min || v > max ? def : v;
+}
+
+static struct stft *spectrum_open(void)
+{
+	int size, hop, win, floor, ceil;
+	struct stft *st;
+	char *s;
 
-	memset(tim, 0, sizeof(*tim) * count);
-	for (i = 0; i < count; i++)
-		tre[i] = transform(-32767, 32766, b[i], -1.0, 1.0);
-	complex_dft(count, tre, tim, fre, fim);
+	printf("set DBAUD_FFT_SIZE, DBAUD_FFT_HOP, DBAUD_FFT_WINDOW"
+	       " (rect/hann/hamming/blackman) to override the analysis\n");
+	size = env_int("DBAUD_FFT_SIZE", FFT_SIZE, 16, 1 << 22);
+	hop = env_int("DBAUD_FFT_HOP", MIN(FFT_HOP, size), 1, size);
+	s = getenv("DBAUD_FFT_WINDOW");
+	win = s ? stft_window(s) : WIN_HANN;
+	if (win < 0)
+		win = WIN_HANN;
+
+	printf("fft size:%d hop:%d window:%s\n", size, hop,
+	       stft_window_name(win));
+	st = stft_create(size, hop, win);
+	if (!st)
+		return NULL;
 
-		//(FLOAT) i / (FLOAT) duration,
-	for (i = 0; i < count / 2; i++)
-		fre[i] = 0.5f * POW(fre[i] * fre[i] + fim[i] * fim[i], 0.5f);
-	return fre;
+	printf("set DBAUD_DB_FLOOR, DBAUD_DB_CEIL to override the spectrum range\n");
+	floor = env_int("DBAUD_DB_FLOOR", stft_db_floor(st), STFT_DB_MIN, 99);
+	ceil = env_int("DBAUD_DB_CEIL", stft_db_ceil(st), floor + 1, 100);
+	if (stft_db_range(st, floor, ceil))
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+	printf("spectrum range: %.0f to %.0f dB\n", stft_db_floor(st),
+	       stft_db_ceil(st));
+	return st;
 }
-#else
-float *do_dft(s16 *b, int count)
+
+#define PSD_FRAMES	32
+#define PEAK_DECAY_DB	20	/* per second */
+
+static struct psd *psd_open(struct stft *st, int rate)
 {
-	static complex *c;
-	static complex *t;
-	static float *r;
-	int i;
+	int mode, frames, decay;
+	struct psd *p;
+	char *s;
 
-	count /= 2;
-	if (!c) {
-		c = malloc(sizeof(*c) * count);
-		t = malloc(sizeof(*t) * count);
-		r = malloc(sizeof(*r) * count);
-	}
-	for (i = 0; i < count; i++) {
-		c[i].Re = transform(-32767, 32766, b[2 * i], -1.0, 1.0);
-		c[i].Im = 0;
-	}
-	fft(c, count, t);
-	for (i = 0; i < count; i++)
-		r[i] = fabs(c[i].Re) + fabs(c[i].Im);
-	return r;
+	printf("set DBAUD_PSD_FRAMES, DBAUD_PSD_MODE (exp/block) and"
+	       " DBAUD_PEAK_DECAY (dB/s) to override the averaging, 'a' shows"
+	       " the average and peak hold, 'z' restarts them\n");
+	frames = env_int("DBAUD_PSD_FRAMES", PSD_FRAMES, 1, 1 << 20);
+	decay = env_int("DBAUD_PEAK_DECAY", PEAK_DECAY_DB, 0, 1000);
+	s = getenv("DBAUD_PSD_MODE");
+	mode = s ? psd_mode(s) : PSD_EXP;
+	if (mode < 0)
+		mode = PSD_EXP;
+
+	p = psd_create(stft_bins(st), mode, frames,
+		       powf(10.0f, -decay / 10.0f * stft_hop(st) / rate));
+	if (!p)
+		return NULL;
+	printf("psd: %s over %d frames, peak decay %d dB/s\n",
+	       psd_mode_name(mode), frames, decay);
+	return p;
 }
-#endif
 
+#define BRDR			30
+/* waterfall, over the scope and clear of the spectrum */
+#define WF_Y			20
+#define WF_BOTTOM		240
 #define DFT_BORDER		80
 #define SKIP_END_FRAMES		3
+/* range of the filterbank axes */
+#define SPEC_FMIN		40
+#define SPEC_FMAX		20000
+#define SPEC_HT			180
+#define SPEC_DB_STEP		20
 
-//static float _fmax = 10.0;
-//static float _fmax = 1300.0;
-void display_spectrum(struct dbx *d, struct audioparam *ap, s16 *b)
+/*
+ * Everything that maps screen columns to samples and bins, rebuilt only
+ * when the window changes size instead of per column per frame.  pts/segs
+ * are the point arrays for the batched dbx calls, spans the scope columns.
+ */
+struct layout {
+	int wd, ht, bins, scale;
+	int dirty;
+	XPoint *pts;
+	struct dbx_segment *segs;
+	struct wave_span *spans;
+	int *spec_lo, *spec_hi;		/* x - DFT_BORDER -> bins [lo, hi) */
+	float *spec_val;
+	struct bands *bands;		/* g_scale filterbank, not for linear */
+	float *band_out;
+	short *band_x;
+	float wave_y0, wave_dy;		/* y = y0 + v * dy */
+	struct waterfall *wf;		/* scope area, starts over on resize */
+};
+
+static struct layout g_lay = { .dirty = 1 };
+
+static void layout_free_bands(struct layout *l)
+{
+	bands_destroy(l->bands);
+	free(l->band_out);
+	free(l->band_x);
+	l->bands = NULL;
+	l->band_out = NULL;
+	l->band_x = NULL;
+}
+
+static void layout_free(struct layout *l)
+{
+	free(l->pts);
+	free(l->segs);
+	free(l->spans);
+	free(l->spec_lo);
+	free(l->spec_hi);
+	free(l->spec_val);
+	layout_free_bands(l);
+	waterfall_destroy(l->wf);
+	l->wf = NULL;
+	l->pts = NULL;
+	l->segs = NULL;
+	l->spans = NULL;
+	l->spec_lo = NULL;
+	l->spec_hi = NULL;
+	l->spec_val = NULL;
+}
+
+/* the filterbank axis, one band per column */
+static int layout_bands(struct layout *l, int wd, struct stft *st, int rate)
+{
+	float fmax = MIN(SPEC_FMAX, rate / 2);
+	int i, n;
+
+	/* no room for a spectrum, the linear path draws nothing either */
+	if (g_scale == SCALE_LINEAR || wd - 2 * DFT_BORDER <= 0)
+		return 0;
+	l->bands = bands_create(g_scale, wd - 2 * DFT_BORDER, stft_size(st),
+				rate, SPEC_FMIN, fmax);
+	if (!l->bands)
+		return -1;
+	n = bands_count(l->bands);
+	l->band_out = malloc(sizeof(*l->band_out) * n);
+	l->band_x = malloc(sizeof(*l->band_x) * n);
+	if (!l->band_out || !l->band_x)
+		return -1;
+	for (i = 0; i < n; i++)
+		l->band_x[i] = DFT_BORDER + (wd - 2 * DFT_BORDER) *
+			scale_pos(g_scale, bands_center(l->bands, i),
+				  SPEC_FMIN, fmax);
+	return 0;
+}
+
+static int layout_update(struct layout *l, int wd, int ht, struct stft *st,
+			 int rate)
+{
+	int x, n, bins = stft_bins(st);
+	int spec = bins / 2 - 2 * SKIP_END_FRAMES;
+
+	if (!l->dirty && l->wd == wd && l->ht == ht && l->bins == bins &&
+	    l->scale == g_scale)
+		return 0;
+
+	layout_free(l);
+	/* the axis is optional, without it the spectrum stays linear */
+	if (layout_bands(l, wd, st, rate)) {
+		printf("%s axis failed, using linear\n", scale_name(g_scale));
+		layout_free_bands(l);
+	}
+
+	/* one point per column, or per band on the filterbank path */
+	n = MAX(wd, 1);
+	if (l->bands)
+		n = MAX(n, bands_count(l->bands));
+	l->pts = malloc(sizeof(*l->pts) * n);
+	l->segs = malloc(sizeof(*l->segs) * n * 2);
+	l->spans = malloc(sizeof(*l->spans) * n);
+	l->spec_lo = malloc(sizeof(*l->spec_lo) * n);
+	l->spec_hi = malloc(sizeof(*l->spec_hi) * n);
+	l->spec_val = malloc(sizeof(*l->spec_val) * n);
+	if (!l->pts || !l->segs || !l->spans || !l->spec_lo || !l->spec_hi ||
+	    !l->spec_val) {
+		layout_free(l);
+		l->dirty = 1;
+		return -1;
+	}
+
+	/*
+	 * bins up to a quarter of the rate, 0 - 11kHz at 44.1kHz, each column
+	 * covering its share of them and at least one
+	 */
+	for (x = 0; x < wd - 2 * DFT_BORDER; x++) {
+		l->spec_lo[x] = SKIP_END_FRAMES + (long long)x * spec /
+				(wd - 2 * DFT_BORDER);
+		l->spec_hi[x] = SKIP_END_FRAMES + (long long)(x + 1) * spec /
+				(wd - 2 * DFT_BORDER);
+		l->spec_hi[x] = MAX(l->spec_hi[x], l->spec_lo[x] + 1);
+	}
+	l->wf = waterfall_create(wd - 2 * BRDR, ht - WF_Y - WF_BOTTOM,
+				 SKIP_END_FRAMES, spec);
+	l->wave_y0 = transform(-32767, 32766, 0, ht - 20, 20);
+	l->wave_dy = (float)(20 - (ht - 20)) / (32766 + 32767);
+
+	l->wd = wd;
+	l->ht = ht;
+	l->bins = bins;
+	l->scale = g_scale;
+	l->dirty = 0;
+	return 0;
+}
+
+static int configure(struct dbx *d, XConfigureEvent *e)
+{
+	g_lay.dirty = 1;
+	return 0;
+}
+
+/* SPEC_HT pixels above the axis for the dB range */
+static int spectrum_y(struct dbx *d, struct stft *st, float db)
+{
+	float lo = stft_db_floor(st);
+
+	return dbx_height(d) - 40 -
+	       (int)((db - lo) * SPEC_HT / (stft_db_ceil(st) - lo));
+}
+
+/*
+ * One trace, from the power through the filterbank (one sparse mat-vec for
+ * the whole axis, a point per band) or from the loudest dB bin of every
+ * column on the linear axis.
+ */
+static void display_trace(struct dbx *d, struct stft *st, const float *pow,
+			  const float *db, u32 color)
 {
-	int ht = dbx_height(d);
 	int wd = dbx_width(d);
-	int px = DFT_BORDER, py = -1;
-	int x, y, s, i;
-	//static float fmax;
-	float fs, fy, v;
-	float _fmax = 10.0;
-	float *f = do_dft(b, ap->frames);
-	char str[3];
+	int i, n = wd - 2 * DFT_BORDER;
+	float *v = g_lay.spec_val;
+
+	if (g_lay.bands) {
+		n = bands_count(g_lay.bands);
+		v = g_lay.band_out;
+		bands_apply(g_lay.bands, pow, v);
+		dsp_db(v, n, v, stft_db_floor(st), stft_db_ceil(st));
+		for (i = 0; i < n; i++)
+			g_lay.pts[i] = (XPoint){ g_lay.band_x[i],
+						 spectrum_y(d, st, v[i]) };
+	} else {
+		if (n <= 0)
+			return;
+		dsp_max_ranges(db, g_lay.spec_lo, g_lay.spec_hi, n, v);
+		for (i = 0; i < n; i++)
+			g_lay.pts[i] = (XPoint){ DFT_BORDER + i,
+						 spectrum_y(d, st, v[i]) };
+	}
+	dbx_draw_polyline(d, g_lay.pts, n, color);
+}
+
+/* the peak hold, the last frame and on top the steadier average */
+void display_spectrum(struct dbx *d, struct stft *st)
+{
+	int psd = g_traces && psd_count(g_psd);
 
-	s = ap->frames / 4;
-	for (i = SKIP_END_FRAMES; i < s - SKIP_END_FRAMES; i++) {
-		if (f[i] > _fmax)
-			_fmax = f[i];
+	if (psd) {
+		psd_db(g_psd, stft_db_floor(st), stft_db_ceil(st));
+		display_trace(d, st, psd_peak(g_psd), psd_peak_db(g_psd),
+			      PEAK_COLOR);
+	}
+	display_trace(d, st, stft_power(st), stft_db(st), GREEN1);
+	/* a block average only exists once the first run has ended */
+	if (psd && psd_avg_count(g_psd))
+		display_trace(d, st, psd_avg(g_psd), psd_avg_db(g_psd),
+			      AVG_COLOR);
+}
+
+/* a label every SPEC_DB_STEP dB left of the plot */
+static void db_axis(struct dbx *d, struct stft *st)
+{
+	int db, y, lo = stft_db_floor(st), hi = stft_db_ceil(st);
+	char str[8];
+
+	for (db = hi; db >= lo; db -= SPEC_DB_STEP) {
+		y = spectrum_y(d, st, db);
+		dbx_draw_line(d, DFT_BORDER - 6, y, DFT_BORDER - 1, y,
+			      RGB(255, 255, 255));
+		snprintf(str, sizeof(str), "%d", db);
+		dbx_draw_string(d, DFT_BORDER - 10 - 6 * strlen(str), y + 3, str,
+				strlen(str), RGB(100, 100, 100));
 	}
+	dbx_draw_string(d, DFT_BORDER - 22, spectrum_y(d, st, hi) - 12, "dB",
+			2, RGB(100, 100, 100));
+}
 
-	for (x = DFT_BORDER; x < wd - DFT_BORDER; x++) {
-		fs = transform(DFT_BORDER, wd - DFT_BORDER, x,
-				SKIP_END_FRAMES, s - SKIP_END_FRAMES);
-		v = f[(int)fs];
+/* 1-2-5 ticks for the filterbank axes */
+static void bands_axes(struct dbx *d, u32 rate)
+{
+	static const int mult[] = { 1, 2, 5 };
+	float fmax = MIN(SPEC_FMAX, rate / 2);
+	int ht = dbx_height(d);
+	int wd = dbx_width(d);
+	int x, i, f, dec;
+	char str[16];
+
+	dbx_draw_string(d, wd / 2, ht - 10, "Hz", 2, RGB(100, 100, 100));
+	dbx_draw_string(d, wd - DFT_BORDER + 10, ht - 10, scale_name(g_scale),
+			strlen(scale_name(g_scale)), RGB(100, 100, 100));
+	for (dec = 10; dec <= fmax; dec *= 10) {
+		for (i = 0; i < ARRAY_SIZE(mult); i++) {
+			f = dec * mult[i];
+			if (f < SPEC_FMIN || f > fmax)
+				continue;
+			x = DFT_BORDER + (wd - 2 * DFT_BORDER) *
+				scale_pos(g_scale, f, SPEC_FMIN, fmax);
+
+			dbx_draw_line(d, x, ht - 34, x, ht - 40,
+				      RGB(255, 255, 255));
+
+			if (f >= 1000)
+				snprintf(str, sizeof(str), "%dk", f / 1000);
+			else
+				snprintf(str, sizeof(str), "%d", f);
+			dbx_draw_string(d, x - 3 * strlen(str), ht - 20, str,
+					strlen(str), RGB(100, 100, 100));
+		}
+	}
+}
 
-		if (v > _fmax)
-			v = _fmax;
-		fy = transform(0, _fmax, v, ht - 40, ht - 220);
-		y = (int)fy;
-		if (py < 0)
-			py = y;
+/* kHz ticks and labels, part of the static background */
+static void spectrum_axes(struct dbx *d, u32 rate, struct stft *st)
+{
+	int ht = dbx_height(d);
+	int wd = dbx_width(d);
+	int x, s, i;
+	float v;
+	char str[3];
 
-		dbx_draw_line(d, px, py, x, y, GREEN1);
-		px = x;
-		py = y;
+	if (g_lay.bands) {
+		bands_axes(d, rate);
+		return;
 	}
 
-	/*
-		period  = 0.031133 sec
-		samples = 1373 (686)
-		f = s / 0.031
-	*/
+	s = stft_bins(st) / 2;
+
+	/* bin = f * fft size / rate */
 	dbx_draw_string(d, wd / 2, ht - 10, "kHz", 3, RGB(100, 100, 100));
 	//for (i = 0; i < 40; i++) {
 	//	v = 0.031133 * 500 * i;
 	for (i = 0; i < 12; i++) {
-		v = 0.031133 * 1000 * i;
+		v = 1000.0f * i * stft_size(st) / rate;
 		//x = transform(0, ap->frames / 2, v,
 		x = transform(SKIP_END_FRAMES, s - SKIP_END_FRAMES, v,
 				DFT_BORDER, wd - DFT_BORDER);
@@ -711,56 +1047,355 @@ void display_spectrum(struct dbx *d, struct audioparam *ap, s16 *b)
 	}
 }
 
+static u32 g_bg_drawn;
+
+/* everything that only changes with the window, the rate or bg_color */
+static int background(struct dbx *d)
+{
+	int ht = dbx_height(d);
+	int wd = dbx_width(d);
+
+	dbx_fill_rectangle(d, 0, 0, wd, ht, bg_color);
+	dbx_draw_rectangle(d, 0, 0, wd - 1, ht - 1, RGB(40, 40, 40));
+	spectrum_axes(d, g_cap.src->rate, g_stft);
+	db_axis(d, g_stft);
+	g_bg_drawn = bg_color;
+	return 0;
+}
+
+/*
+ * The scope shows frames << zoom samples (>> -zoom zooming in) of the
+ * history, up to all of it, each column a min/max span over all of its
+ * samples with the rms as a lighter band inside.  It ends at the newest
+ * sample or, panned back, at g_scope_end.
+ */
+#define SCOPE_MIN_LEN	16
+
+static int scope_len(int frames)
+{
+	int max = wave_size(g_wave), len;
+
+	for ( ;; ) {
+		len = g_zoom >= 0 ? frames << g_zoom : frames >> -g_zoom;
+		if (len > max && g_zoom > 0)
+			g_zoom--;
+		else if (len < SCOPE_MIN_LEN && g_zoom < 0)
+			g_zoom++;
+		else
+			return MAX(MIN(len, max), 1);
+	}
+}
+
+static int scope_y(int v, int amp)
+{
+	int_mod(&v, -32767, 32766, v * amp);
+	return (int)(g_lay.wave_y0 + v * g_lay.wave_dy);
+}
+
+/* halfway to white */
+static u32 lighter(u32 c)
+{
+	return ((c >> 1) & 0x7f7f7f) + 0x808080;
+}
+
+static void display_scope(struct dbx *d, int frames)
+{
+	unsigned long long oldest = wave_oldest(g_wave);
+	unsigned long long end = g_scope_end ? g_scope_end : wave_head(g_wave);
+	int wd = dbx_width(d);
+	int amp = display_amp();
+	int cols = wd - 2 * BRDR;
+	int c, x, len, top, bot, rt, rb, pt = 0, pb = 0;
+	struct dbx_segment *seg = g_lay.segs;
+	struct wave_span *sp = g_lay.spans;
+	u32 clr = fg_color;
+
+	len = MIN(scope_len(frames), wave_head(g_wave) - oldest);
+	g_scope_len = len;
+	/* a panned view slides along once the history overwrites it */
+	end = MAX(end, oldest + len);
+	if (cols <= 0 || !len || wave_columns(g_wave, end - len, len, sp, cols))
+		return;
+
+	for (c = 0; c < cols; c++) {
+		x = BRDR + c;
+		top = scope_y(sp[c].max, amp);
+		bot = scope_y(sp[c].min, amp);
+		/* reach the previous span so steep edges stay connected */
+		if (c && top > pb)
+			top = pb;
+		if (c && bot < pt)
+			bot = pt;
+		pt = top;
+		pb = bot;
+
+		/* a new color per column */
+		if (fg_n_bg && rainbow_static) {
+			random_color(&fg_color);
+			clr = fg_color;
+		}
+		seg[c] = (struct dbx_segment){ x, top, x, bot, clr };
+
+		rt = MAX(scope_y((int)sp[c].rms, amp), top);
+		rb = MIN(scope_y(-(int)sp[c].rms, amp), bot);
+		seg[cols + c] = (struct dbx_segment){ x, rt, x, MAX(rt, rb),
+						      lighter(clr) };
+	}
+	dbx_draw_segments(d, seg, cols);
+	dbx_draw_segments(d, seg + cols, cols);
+}
+
+/* the circular image as it is, oldest column on the left */
+static void display_waterfall(struct dbx *d)
+{
+	struct waterfall *wf = g_lay.wf;
+
+	if (!wf)
+		return;
+	dbx_draw_image(d, BRDR, WF_Y, wf->px + wf->pos, wf->width,
+		       wf->width - wf->pos, wf->height);
+	dbx_draw_image(d, BRDR + wf->width - wf->pos, WF_Y, wf->px, wf->width,
+		       wf->pos, wf->height);
+}
+
+/* feed captured samples to the STFT the moment the main loop wakes */
+static void audio_consume(const s16 *pcm, int frames)
+{
+	if (_pause)
+		return;
+	wave_push(g_wave, pcm, frames);
+	stft_push(g_stft, pcm, frames);
+	while (stft_next(g_stft)) {
+		psd_update(g_psd, stft_power(g_stft));
+		if (g_waterfall && g_lay.wf)
+			waterfall_column(g_lay.wf, stft_db(g_stft));
+	}
+}
+
+/*
+ * Control socket for scripts: every connection is answered with the
+ * current spectra as text and closed, e.g.
+ *   socat -u UNIX-CONNECT:$DBAUD_CTL_SOCK -
+ * A '#' header with the analysis settings and the number of bins, then
+ * psd_print().  The reply is formatted up front and written as the socket
+ * takes it, each connection in flight has a slot in the poll set, so a
+ * slow reader costs the loop nothing and still gets all of it.  One that
+ * takes nothing for CTL_TIMEOUT_MS is dropped.
+ */
+#define CTL_MAX_CLIENTS	4	/* in flight, the rest wait in the backlog */
+#define CTL_TIMEOUT_MS	5000
+
+struct ctl_client {
+	int fd;
+	char *buf;
+	size_t len, off;
+	u32 last;		/* tickcount_ms() of the last progress */
+};
+
+static int g_ctl_fd = -1;
+static const char *g_ctl_path;
+static struct ctl_client g_ctl[CTL_MAX_CLIENTS];
+static int g_cap_fds;		/* pfd entries of the capture, ctl after */
+
+static int ctl_open(const char *path)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	int i, fd;
+
+	if (strlen(path) >= sizeof(sa.sun_path)) {
+		printf("%s: path too long\n", path);
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		printf("%s:%d %s() %s\n", __FILE__, __LINE__, __func__,
+		       strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 4)) {
+		printf("%s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	for (i = 0; i < CTL_MAX_CLIENTS; i++)
+		g_ctl[i].fd = -1;
+	g_ctl_fd = fd;
+	g_ctl_path = path;
+	printf("control socket: %s\n", path);
+	return 0;
+}
+
+static void ctl_drop(struct ctl_client *c)
+{
+	close(c->fd);
+	free(c->buf);
+	*c = (struct ctl_client){ .fd = -1 };
+}
+
+static void ctl_close(void)
+{
+	int i;
+
+	if (g_ctl_fd < 0)
+		return;
+	for (i = 0; i < CTL_MAX_CLIENTS; i++)
+		if (g_ctl[i].fd >= 0)
+			ctl_drop(&g_ctl[i]);
+	close(g_ctl_fd);
+	unlink(g_ctl_path);
+	g_ctl_fd = -1;
+}
+
+/* as much as the socket takes now, dropped when done or on an error */
+static void ctl_send(struct ctl_client *c)
+{
+	ssize_t ret;
+
+	while (c->off < c->len) {
+		ret = send(c->fd, c->buf + c->off, c->len - c->off,
+			   MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if (ret <= 0)
+			break;
+		c->off += ret;
+		c->last = tickcount_ms();
+	}
+	ctl_drop(c);
+}
+
+static void ctl_reply(struct ctl_client *c, int fd)
+{
+	float floor = stft_db_floor(g_stft), ceil = stft_db_ceil(g_stft);
+	FILE *f;
+
+	c->fd = fd;
+	c->last = tickcount_ms();
+	f = open_memstream(&c->buf, &c->len);
+	if (!f) {
+		ctl_drop(c);
+		return;
+	}
+	fprintf(f, "# rate %d fft %d hop %d window %s bins %d\n",
+		g_cap.src->rate, stft_size(g_stft), stft_hop(g_stft),
+		stft_window_name(stft_window_of(g_stft)), stft_bins(g_stft));
+	fprintf(f, "# floor %.0f ceil %.0f frames %lu averaged %lu\n", floor,
+		ceil, psd_count(g_psd), psd_avg_count(g_psd));
+	psd_print(g_psd, f, stft_db(g_stft),
+		  (float)g_cap.src->rate / stft_size(g_stft), floor, ceil);
+	if (fclose(f)) {
+		ctl_drop(c);
+		return;
+	}
+	ctl_send(c);
+}
+
+/*
+ * pfd[0] is the listening socket, pfd[1 + i] the client in slot i.  The
+ * listening socket leaves the poll set while every slot is busy.
+ */
+static void ctl_poll(struct pollfd *pfd)
+{
+	struct ctl_client *c;
+	int i, fd, busy = 0;
+
+	for (i = 0; i < CTL_MAX_CLIENTS; i++) {
+		c = &g_ctl[i];
+		if (c->fd >= 0 && pfd[1 + i].revents)
+			ctl_send(c);
+		if (c->fd >= 0 && tickcount_ms() - c->last > CTL_TIMEOUT_MS)
+			ctl_drop(c);
+	}
+	for (i = 0; i < CTL_MAX_CLIENTS && pfd[0].revents; i++) {
+		c = &g_ctl[i];
+		if (c->fd >= 0)
+			continue;
+		fd = accept4(g_ctl_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			break;
+		ctl_reply(c, fd);
+	}
+	for (i = 0; i < CTL_MAX_CLIENTS; i++) {
+		pfd[1 + i].fd = g_ctl[i].fd;
+		busy += g_ctl[i].fd >= 0;
+	}
+	pfd[0].fd = busy < CTL_MAX_CLIENTS ? g_ctl_fd : -1;
+}
+
+static int audio_in(struct dbx *d, struct pollfd *pfd, int n)
+{
+	int i;
+
+	if (g_ctl_fd >= 0)
+		ctl_poll(pfd + g_cap_fds);
+	for (i = 0; i < g_cap_fds; i++)
+		if (pfd[i].revents)
+			return capture_ready(&g_cap, pfd, g_cap_fds) < 0 ? -1 : 0;
+	return 0;
+}
+
+static int audio_fds(struct dbx *d, struct pollfd *pfd, int max)
+{
+	int i;
+
+	g_cap_fds = capture_fds(&g_cap, pfd, max);
+	if (g_cap_fds < 0 || g_ctl_fd < 0)
+		return g_cap_fds;
+	if (g_cap_fds + 1 + CTL_MAX_CLIENTS > max) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		return -1;
+	}
+	pfd[g_cap_fds] = (struct pollfd){ .fd = g_ctl_fd, .events = POLLIN };
+	for (i = 0; i < CTL_MAX_CLIENTS; i++)
+		pfd[g_cap_fds + 1 + i] = (struct pollfd){ .fd = -1,
+							  .events = POLLOUT };
+	return g_cap_fds + 1 + CTL_MAX_CLIENTS;
+}
+
 static int state_update(struct dbx *d)
 {
-	struct audioparam *ap = &g_in_ap;
+	struct source *src = g_cap.src;
 	int ht = dbx_height(d);
 	int wd = dbx_width(d);
-	float fs, fy;
-	s16 *b;
-	int x, y, v;
-	int px, py = ht / 2;
+	int frames;
 
-	b = audio_read(ap);
-	if (!b)
+	if (!g_cap.fresh) {
+		g_cap.underruns++;
 		return 0;
+	}
+	g_cap.fresh = 0;
 
-	if (_pause)
+	/* paused, only a zoom or pan redraws the frozen history */
+	if (_pause && !g_view_moved)
 		return 0;
+	g_view_moved = 0;
+
+	/* unzoomed the scope shows one period */
+	frames = src->frames;
 
 	//dbx_blank_pixmap(d);
 
+	if (layout_update(&g_lay, wd, ht, g_stft, src->rate))
+		return 0;
+
 	if (!rainbow_static)
 		update_color();
 	else if (!fg_n_bg)
 		random_color(&bg_color);
 
-	dbx_fill_rectangle(d, 0, 0, wd, ht, bg_color);
-	dbx_draw_rectangle(d, 0, 0, wd - 1, ht - 1, RGB(40, 40, 40));
-
-#define BRDR	30
-	px = -1;
-	for (x = BRDR; x < wd - BRDR; x++) {
-		if (px < 0)
-			px = x;
-		fs = transform(BRDR, wd - BRDR, x, 0, ap->frames);
-		v = b[(int)fs];
-
-		int_mod(&v, -32767, 32766, v * display_amp());
+	if (bg_color != g_bg_drawn)
+		dbx_invalidate_background(d);
+	dbx_blit_background(d);
 
-		fy = transform(-32767, 32766, v, ht - 20, 20);
-		y = (int)fy;
-
-		if (fg_n_bg && rainbow_static)
-			random_color(&fg_color);
-
-		//dbx_draw_point(d, x, y, fg_color);
-		dbx_draw_line(d, px, py, x, y, fg_color);
-		px = x;
-		py = y;
-	}
+	if (g_waterfall)
+		display_waterfall(d);
+	else
+		display_scope(d, frames);
 
-	display_spectrum(d, ap, b);
+	display_spectrum(d, g_stft);
 
 	do_xps(d);
 
@@ -768,17 +1403,24 @@ static int state_update(struct dbx *d)
 }
 
 #define UPDATE_PERIOD_MS	30
+#define UPDATE_FPS		(1000 / UPDATE_PERIOD_MS)
 int main(int argc, char *argv[])
 {
 	struct dbx_ops ops = {
 		.update = state_update,
 		.motion = NULL,
 		.key = key,
-		.configure = NULL,
+		.configure = configure,
 		.button = button,
+		.poll_fds = audio_fds,
+		.poll_in = audio_in,
+		.background = background,
 	};
-	struct audioparam *iap, *oap;
-	int rate, channels, frames;
+	struct source_param sp = { .speed = 1.0f };
+	struct dbx_headless hl = { .width = 0 };
+	struct source *src;
+	int rate, frames, period_ms, fps, tone_ok = 0;
+	char *s;
 
 	/*
 	 * samples / second
@@ -786,34 +1428,113 @@ int main(int argc, char *argv[])
 	 *  1000000 / 44100 ~= 22 microseconds / sample
 	 */
 	rate = 44100;
-	channels = 1;
 	/*
 	 * API poll rate
 	 * 10 milliseconds == 10000 microseconds
 	 *  10000 / 22 == 454 samples
 	 * 1 frame == 1 sample per channel
 	 */
-	frames = (UPDATE_PERIOD_MS * 1000) / (1000000 / rate);
+	printf("set DBAUD_PERIOD_MS, DBAUD_FPS to override the capture period"
+	       " and the redraw rate (0 redraws on every period)\n");
+	period_ms = env_int("DBAUD_PERIOD_MS", UPDATE_PERIOD_MS, 1, 500);
+	fps = env_int("DBAUD_FPS", UPDATE_FPS, 0, 240);
+	frames = (period_ms * 1000) / (1000000 / rate);
+
+	printf("set DBAUD_SOURCE (alsa, file:<wav/raw>, synth[:<parts>]),"
+	       " DBAUD_SPEED (x real time, 0 unpaced) and DBAUD_MMAP=1"
+	       " to pick the input\n");
+	s = getenv("DBAUD_SPEED");
+	if (s)
+		sp.speed = MAX(strtof(s, NULL), 0.0f);
+	sp.rate = rate;
+	sp.frames = frames + 10;
+	sp.mmap = env_int("DBAUD_MMAP", 0, 0, 1);
+	s = getenv("DBAUD_SOURCE");
+	src = source_open(s ? s : "alsa", &sp);
+	if (!src) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		exit(0);
+	}
 
-	/* buffer size == samples * channels * bits per sample */
-	iap = audio_open(channels, rate, frames + 10, 1);
-	if (!iap) {
+	g_stft = spectrum_open();
+	if (!g_stft) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		exit(0);
+	}
+	g_psd = psd_open(g_stft, src->rate);
+	if (!g_psd) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		exit(0);
+	}
+	printf("set DBAUD_CTL_SOCK=<path> to serve the spectra to scripts\n");
+	s = getenv("DBAUD_CTL_SOCK");
+	if (s && ctl_open(s))
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+	printf("set DBAUD_HISTORY_SEC to override the scrollback,"
+	       " '+'/'-' zoom the scope, '['/']' pan it, '\\' back to live,"
+	       " 'w' swaps it for a spectrogram\n");
+	g_wave = wave_create(src->rate * env_int("DBAUD_HISTORY_SEC",
+						 HISTORY_SEC, 1, 3600));
+	if (!g_wave) {
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
 		exit(0);
 	}
 
-	oap = audio_open(2, rate, frames, 0);
-	if (!oap) {
+	printf("set DBAUD_CAPTURE_SLOTS to override the capture ring depth,"
+	       " DBAUD_CAPTURE=poll to read the pcm from the main loop,"
+	       " 'i' prints capture counters\n");
+	s = getenv("DBAUD_CAPTURE");
+	if (capture_start(&g_cap, src, env_int("DBAUD_CAPTURE_SLOTS",
+					       CAPTURE_SLOTS, 2, 4096),
+			  (s && !strcmp(s, "poll")) || sp.mmap, audio_consume)) {
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
 		exit(0);
 	}
-	tone_out();
 
-	dbx_run(argc, argv, &ops, UPDATE_PERIOD_MS);
+	/* tones are a nicety, run without them when there is no device */
+	printf("set DBAUD_TONE=0 to disable the tone output\n");
+	if (env_int("DBAUD_TONE", 1, 0, 1)) {
+		tone_ok = !audio_open(&g_out_ap, 2, rate, frames, 0, 0);
+		if (tone_ok)
+			tone_out();
+		else
+			printf("no playback device, tone output disabled\n");
+	}
+
+	printf("set DBAUD_HEADLESS=<w>x<h> to render without X, DBAUD_DUMP=<file>"
+	       " (may take %%d for the frame) and DBAUD_FRAMES to save frames\n");
+	s = getenv("DBAUD_HEADLESS");
+	if (s && sscanf(s, "%dx%d", &hl.width, &hl.height) == 2 &&
+	    hl.width > 0 && hl.height > 0) {
+		hl.dump = getenv("DBAUD_DUMP");
+		hl.frames = env_int("DBAUD_FRAMES", 0, 0, INT32_MAX);
+	}
+
+	printf("set DBAUD_RENDER=x to draw with Xlib, =image to upload frames"
+	       " without MIT-SHM\n");
+	s = getenv("DBAUD_RENDER");
+	if (s && !strcmp(s, "x"))
+		dbx_set_render(DBX_RENDER_X);
+	else if (s && !strcmp(s, "image"))
+		dbx_set_render(DBX_RENDER_IMAGE);
+
+	printf("redraw: %d fps\n", fps);
+	if (hl.width)
+		dbx_run_headless(&hl, &ops, fps ? 1000 / fps : 0);
+	else
+		dbx_run(argc, argv, &ops, fps ? 1000 / fps : 0);
 
 	do_tone = 0;
 	usleep(1000 * 10);
-	audio_close(iap);
-	audio_close(oap);
+	history_stats();
+	ctl_close();
+	capture_stop(&g_cap);
+	source_close(src);
+	if (tone_ok)
+		audio_close(&g_out_ap);
+	psd_destroy(g_psd);
+	stft_destroy(g_stft);
+	wave_destroy(g_wave);
+	layout_free(&g_lay);
 	return EXIT_SUCCESS;
 }
@@ -1,9 +1,17 @@
 /* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <time.h>
 
 #include "dbx.h"
+#include "fb.h"
+
+#include <X11/extensions/XShm.h>
 
 u32 tickcount_ms(void)
 {
@@ -33,7 +41,14 @@ void int_mod(int *v, int min, int max, int delta)
 
 /******************************************************************************/
 
-#define CLR_CNT	2500
+/* non-TrueColor pixel cache, open addressing, power of two */
+#define CLR_HASH	1024
+
+struct clr_entry {
+	u32 rgb;
+	int used;
+	unsigned long pixel;
+};
 
 struct dbx {
 	XFontStruct *font;
@@ -45,9 +60,35 @@ struct dbx {
 	int width;
 	int height;
 	GC gc;
-	XColor colors[CLR_CNT];
-	u32 rgbs[CLR_CNT];
+	int truecolor;
+	int shift[3];			/* red, green, blue */
+	int bits[3];
+	struct clr_entry clr[CLR_HASH];
 	int clr_cnt;
+
+	struct fb *fb;			/* client-side rendering, no X if !display */
+	XImage *image;			/* fb pixels when on X */
+	XShmSegmentInfo shm;
+	int shm_busy;			/* server may still be reading the image */
+	struct dbx_ops *ops;
+	int depth;
+	struct fb *bg;			/* ops->background layer, fb backends */
+	Pixmap bg_pixmap;		/* ... and on the Xlib path */
+	int bg_dirty;
+	XConfigureEvent resize;		/* size to switch to before next frame */
+	int resize_pending;
+
+	XImage *put;			/* dbx_draw_image() on the Xlib path */
+
+	struct dbx_segment *segs;	/* dbx_draw_segments() sort space */
+	XSegment *xsegs;
+	int segs_n;
+	const char *dump;
+	int max_frames;
+
+	int frames;
+	long long render_ns;
+	long long render_max_ns;
 };
 
 static int keycode(Display *display, int k, int shift)
@@ -64,6 +105,28 @@ static int keycode(Display *display, int k, int shift)
 	return ks[(k - min) * syms_per_code + shift];
 }
 
+/* the finished frame to the window, one request either way */
+static int dbx_present(struct dbx *d)
+{
+	if (d->image && d->shm.shmaddr) {
+		XShmPutImage(d->display, d->win, d->gc, d->image, 0, 0, 0, 0,
+			     d->width, d->height, True);
+		d->shm_busy = 1;
+		return 0;
+	}
+	if (d->image) {
+		XPutImage(d->display, d->win, d->gc, d->image, 0, 0, 0, 0,
+			  d->width, d->height);
+		return 0;
+	}
+	if (!XCopyArea(d->display, d->pixmap, d->win, d->gc, 0, 0,
+			d->width, d->height, 0, 0)) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		return -1;
+	}
+	return 0;
+}
+
 static int handle_events(struct dbx *d, struct dbx_ops *ops)
 {
 	XEvent e;
@@ -77,11 +140,8 @@ static int handle_events(struct dbx *d, struct dbx_ops *ops)
 			if (e.xexpose.count)
 				break;
 
-			if (!XCopyArea(d->display, d->pixmap, d->win, d->gc, 0, 0,
-					d->width, d->height, 0, 0)) {
-				printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+			if (dbx_present(d))
 				return -1;
-			}
 			break;
 		case MotionNotify:
 			if (ops->motion)
@@ -89,9 +149,14 @@ static int handle_events(struct dbx *d, struct dbx_ops *ops)
 					return -1;
 			break;
 		case ConfigureNotify:
-			if (ops->configure)
-				if (ops->configure(d, &e.xconfigure))
-					return -1;
+			/* a drag sends a stream of these, only the last counts */
+			if (e.xconfigure.width == d->width &&
+			    e.xconfigure.height == d->height) {
+				d->resize_pending = 0;
+				break;
+			}
+			d->resize = e.xconfigure;
+			d->resize_pending = 1;
 			break;
 		case KeyPress:
 		case KeyRelease:
@@ -109,43 +174,165 @@ static int handle_events(struct dbx *d, struct dbx_ops *ops)
 						e.xbutton.type == ButtonPress))
 					return -1;
 			break;
+		default:
+			if (d->shm.shmaddr &&
+			    e.type == XShmGetEventBase(d->display) + ShmCompletion)
+				d->shm_busy = 0;
+			break;
 		}
 	}
 	return 0;
 }
 
+static long long now_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec * 1000000000LL + tp.tv_nsec;
+}
+
+#define DBX_STATS_FRAMES	100
+
+static void dbx_stats(struct dbx *d)
+{
+	if (!d->frames)
+		return;
+	printf("frames:%d render avg:%.3fms max:%.3fms\n", d->frames,
+	       d->render_ns / 1e6 / d->frames, d->render_max_ns / 1e6);
+}
+
+/*
+ * The dump name goes to snprintf() as the format: only "%%" and one
+ * "%d" with flags and a width ("frame%05d.ppm") are let through.
+ */
+static int dump_name_ok(const char *s)
+{
+	int d = 0;
+
+	for ( ; *s; s++) {
+		if (*s != '%')
+			continue;
+		if (*++s == '%')
+			continue;
+		s += strspn(s, "0-+ #");
+		s += strspn(s, "0123456789");
+		if (*s != 'd' || d++)
+			return 0;
+	}
+	return 1;
+}
+
+static int dbx_dump(struct dbx *d)
+{
+	char path[4096];
+
+	if (!d->dump)
+		return 0;
+	/* the name may take the frame number, "frame%05d.ppm" */
+	snprintf(path, sizeof(path), d->dump, d->frames);
+	return fb_write(d->fb, path);
+}
+
+static int dbx_resize(struct dbx *d);
+
+static int dbx_redraw(struct dbx *d, struct dbx_ops *ops)
+{
+	long long t;
+
+	/* don't draw into the segment while the last put is being read */
+	if (d->shm_busy) {
+		XSync(d->display, False);
+		d->shm_busy = 0;
+	}
+
+	if (d->resize_pending) {
+		d->resize_pending = 0;
+		if (dbx_resize(d))
+			return -1;
+		if (ops->configure && ops->configure(d, &d->resize))
+			return -1;
+	}
+
+	t = now_ns();
+	ops->update(d);
+
+	t = now_ns() - t;
+	d->frames++;
+	d->render_ns += t;
+	d->render_max_ns = MAX(d->render_max_ns, t);
+
+	if (!d->display) {
+		if (!(d->frames % DBX_STATS_FRAMES))
+			dbx_stats(d);
+		if (dbx_dump(d))
+			return -1;
+		return d->max_frames && d->frames >= d->max_frames;
+	}
+
+	return dbx_present(d);
+}
+
+/*
+ * Input descriptors are serviced as soon as they are ready, redraws happen
+ * every t_ms regardless; a late redraw is not made up for with a burst.
+ * With t_ms 0 every wakeup with input is followed by a redraw instead.
+ */
 static void dbx_loop(struct dbx *d, struct dbx_ops *ops, u32 t_ms)
 {
-	int fd = ConnectionNumber(d->display);
-	struct timeval tv = { .tv_sec = 0 };
-	fd_set in_fds;
-	u32 tc, t;
-	int ret;
+	struct pollfd pfd[DBX_MAX_FDS + 1];
+	int ret, i, n = 0, input, timeout;
+	u32 next, t;
+
+	d->ops = ops;
+	d->bg_dirty = 1;
+
+	/* poll() skips negative descriptors, headless there is no X fd */
+	pfd[0].fd = d->display ? ConnectionNumber(d->display) : -1;
+	pfd[0].events = POLLIN;
+	if (ops->poll_fds) {
+		n = ops->poll_fds(d, &pfd[1], DBX_MAX_FDS);
+		if (n < 0)
+			return;
+	}
 
 	ops->update(d);
 
-	tc = tickcount_ms();
+	next = tickcount_ms() + t_ms;
 	for ( ;; ) {
-		FD_ZERO(&in_fds);
-		FD_SET(fd, &in_fds);
-
 		t = tickcount_ms();
-		tv.tv_usec = 1000 * (t_ms - MIN(t_ms, (t - tc)));
+		if (t_ms && (int)(next - t) <= 0) {
+			if (dbx_redraw(d, ops))
+				return;
+			next += t_ms;
+			if ((int)(next - t) <= 0)
+				next = t + t_ms;
+		}
 
-		ret = select(fd + 1, &in_fds, NULL, NULL, &tv);
-		if (ret < 0)
+		t = tickcount_ms();
+		if (!t_ms)
+			timeout = n ? -1 : 0;
+		else
+			timeout = (int)(next - t) > 0 ? (int)(next - t) : 0;
+		ret = poll(pfd, n + 1, timeout);
+		if (ret < 0 && errno != EINTR) {
 			printf("An error occured!\n");
-		else if (ret == 0) {
-			ops->update(d);
-			if (!XCopyArea(d->display, d->pixmap, d->win, d->gc, 0, 0,
-					d->width, d->height, 0, 0)) {
-				printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+			return;
+		}
+
+		input = 0;
+		for (i = 1; ret > 0 && i <= n; i++) {
+			if (!pfd[i].revents)
+				continue;
+			if (ops->poll_in(d, &pfd[1], n))
 				return;
-			}
-			tc = tickcount_ms();
+			input = 1;
+			break;
 		}
+		if (!t_ms && (input || !n) && dbx_redraw(d, ops))
+			return;
 
-		if (handle_events(d, ops))
+		if (d->display && handle_events(d, ops))
 			return;
 	}
 }
@@ -199,18 +386,155 @@ static int set_window_properties(Display *display, Window win, int argc, char *a
 	return 0;
 }
 
+static void mask_shift(unsigned long mask, int *shift, int *bits)
+{
+	*shift = mask ? __builtin_ctzl(mask) : 0;
+	*bits = __builtin_popcountl(mask);
+}
+
+/*
+ * TrueColor pixels are computed from the visual's channel masks, anything
+ * else allocates colors in the default colormap, cached in a hash table.
+ */
 static Colormap init_colormap(struct dbx *d, Window rwin)
 {
-	XVisualInfo vi;
+	Visual *vis = DefaultVisual(d->display, d->screen);
 
 	d->clr_cnt = 0;
+	d->truecolor = vis->class == TrueColor;
+	if (d->truecolor) {
+		mask_shift(vis->red_mask, &d->shift[0], &d->bits[0]);
+		mask_shift(vis->green_mask, &d->shift[1], &d->bits[1]);
+		mask_shift(vis->blue_mask, &d->shift[2], &d->bits[2]);
+	}
 
-	if (!XMatchVisualInfo(d->display, d->screen, 24, TrueColor, &vi)) {
-		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+	return DefaultColormap(d->display, d->screen);
+}
+
+static int dbx_render_mode = DBX_RENDER_AUTO;
+
+void dbx_set_render(int mode)
+{
+	dbx_render_mode = mode;
+}
+
+static int shm_error;
+
+static int shm_error_handler(Display *display, XErrorEvent *e)
+{
+	shm_error = 1;
+	return 0;
+}
+
+static void image_deinit(struct dbx *d)
+{
+	fb_destroy(d->fb);
+	d->fb = NULL;
+	if (!d->image)
+		return;
+	if (d->shm.shmaddr) {
+		XShmDetach(d->display, &d->shm);
+		XSync(d->display, False);
+		shmdt(d->shm.shmaddr);
+		d->shm.shmaddr = NULL;
+		d->image->data = NULL;
+	}
+	XDestroyImage(d->image);
+	d->image = NULL;
+	d->shm_busy = 0;
+}
+
+/* a shared memory XImage, false when the server can't attach to it */
+static int image_shm(struct dbx *d, Visual *vis, int depth)
+{
+	int (*handler)(Display *, XErrorEvent *);
+
+	if (!XShmQueryExtension(d->display))
+		return 0;
+
+	d->image = XShmCreateImage(d->display, vis, depth, ZPixmap, NULL,
+				   &d->shm, d->width, d->height);
+	if (!d->image)
+		return 0;
+
+	d->shm.shmid = shmget(IPC_PRIVATE,
+			      d->image->bytes_per_line * d->image->height,
+			      IPC_CREAT | 0600);
+	if (d->shm.shmid < 0)
+		goto err;
+	d->shm.shmaddr = shmat(d->shm.shmid, NULL, 0);
+	/* gone once both sides have detached */
+	shmctl(d->shm.shmid, IPC_RMID, NULL);
+	if (d->shm.shmaddr == (char *)-1) {
+		d->shm.shmaddr = NULL;
+		goto err;
+	}
+	d->image->data = d->shm.shmaddr;
+	d->shm.readOnly = False;
+
+	/* a remote server fails the attach asynchronously */
+	shm_error = 0;
+	handler = XSetErrorHandler(shm_error_handler);
+	XShmAttach(d->display, &d->shm);
+	XSync(d->display, False);
+	XSetErrorHandler(handler);
+	if (!shm_error)
+		return 1;
+
+	shmdt(d->shm.shmaddr);
+	d->shm.shmaddr = NULL;
+err:
+	d->image->data = NULL;
+	XDestroyImage(d->image);
+	d->image = NULL;
+	return 0;
+}
+
+/*
+ * Client-side rendering: the fb draws straight into an XImage that goes to
+ * the window with a single put per frame.  Needs a 32 bit 0x00RRGGBB
+ * TrueColor layout in host byte order, other visuals keep drawing with Xlib.
+ */
+static int image_init(struct dbx *d)
+{
+	Visual *vis = DefaultVisual(d->display, d->screen);
+	int depth = DefaultDepth(d->display, d->screen);
+	int host = ((union { u16 s; u8 b; }){ .s = 1 }).b ? LSBFirst : MSBFirst;
+	int shm = 0;
+	char *data;
+
+	if (vis->class != TrueColor || vis->red_mask != 0xff0000 ||
+	    vis->green_mask != 0xff00 || vis->blue_mask != 0xff)
+		return -1;
+
+	if (dbx_render_mode != DBX_RENDER_IMAGE)
+		shm = image_shm(d, vis, depth);
+	if (!shm) {
+		d->image = XCreateImage(d->display, vis, depth, ZPixmap, 0, NULL,
+					d->width, d->height, 32, 0);
+		if (!d->image)
+			return -1;
+		data = malloc(d->image->bytes_per_line * d->height);
+		if (!data) {
+			XDestroyImage(d->image);
+			d->image = NULL;
+			return -1;
+		}
+		d->image->data = data;
+	}
+
+	if (d->image->bits_per_pixel != 32 || d->image->byte_order != host) {
+		image_deinit(d);
 		return -1;
 	}
 
-	return XCreateColormap(d->display, rwin, vi.visual, AllocNone);
+	d->fb = fb_wrap((u32 *)d->image->data, d->width, d->height,
+			d->image->bytes_per_line / 4);
+	if (!d->fb) {
+		image_deinit(d);
+		return -1;
+	}
+	return 0;
 }
 
 static int dbx_init(struct dbx *d, int argc, char *argv[])
@@ -226,7 +550,7 @@ static int dbx_init(struct dbx *d, int argc, char *argv[])
 	d->display = XOpenDisplay(display_name);
 	if (!d->display) {
 		fprintf(stderr, "%s: couldn't connect to X server %s\n",
-			argv[0], display_name);
+			argv[0], XDisplayName(display_name));
 		return -1;
 	}
 
@@ -237,6 +561,7 @@ static int dbx_init(struct dbx *d, int argc, char *argv[])
 	display_width = DisplayWidth(d->display, d->screen);
 	display_height = DisplayHeight(d->display, d->screen);
 	depth = DefaultDepth(d->display, d->screen);
+	d->depth = depth;
 
 	d->width  = display_width / 2;
 	d->height = display_height / 2;
@@ -252,28 +577,92 @@ static int dbx_init(struct dbx *d, int argc, char *argv[])
 
 	d->gc = XCreateGC(d->display, d->win, 0, &values);
 
-	d->pixmap = XCreatePixmap(d->display, d->win, d->width, d->height, depth);
-
 	XSelectInput(d->display, d->win, ExposureMask | KeyPressMask |
 			KeyReleaseMask | PointerMotionMask | ButtonPressMask |
 			StructureNotifyMask);
 
+	if (dbx_render_mode != DBX_RENDER_X && !image_init(d)) {
+		printf("rendering client-side, %s\n",
+		       d->shm.shmaddr ? "MIT-SHM" : "XPutImage");
+	} else {
+		printf("rendering with Xlib\n");
+		d->pixmap = XCreatePixmap(d->display, d->win, d->width,
+					  d->height, depth);
+	}
+
 	d->font = XLoadQueryFont(d->display, "9x15");
-	if (!d->font) {
+	if (!d->font && !d->fb) {
 		fprintf(stderr, "%s: cannot open 9x15 font.\n", argv[0]);
 		return -1;
 	}
-	XSetFont(d->display, d->gc, d->font->fid);
+	if (d->font)
+		XSetFont(d->display, d->gc, d->font->fid);
 
 	XMapWindow(d->display, d->win);
 
 	return 0;
 }
 
+/*
+ * Reallocate everything sized to the window for d->resize, the cached
+ * background is redrawn on the next blit.  Runs between frames, the
+ * server is done with the old image (see dbx_redraw()).
+ */
+static int dbx_resize(struct dbx *d)
+{
+	int fb = d->fb != NULL;
+
+	d->width = d->resize.width;
+	d->height = d->resize.height;
+
+	fb_destroy(d->bg);
+	d->bg = NULL;
+	if (d->bg_pixmap)
+		XFreePixmap(d->display, d->bg_pixmap);
+	d->bg_pixmap = 0;
+	d->bg_dirty = 1;
+
+	if (fb) {
+		image_deinit(d);
+		if (image_init(d)) {
+			printf("rendering with Xlib\n");
+			fb = 0;
+		}
+	} else {
+		XFreePixmap(d->display, d->pixmap);
+	}
+	if (!fb) {
+		d->pixmap = XCreatePixmap(d->display, d->win, d->width,
+					  d->height, d->depth);
+		if (!d->pixmap) {
+			printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+			return -1;
+		}
+	}
+
+	return dbx_blank_pixmap(d);
+}
+
 static void dbx_deinit(struct dbx *d)
 {
-	XFreePixmap(d->display, d->pixmap);
-	XUnloadFont(d->display, d->font->fid);
+	fb_destroy(d->bg);
+	if (d->display || d->frames % DBX_STATS_FRAMES)
+		dbx_stats(d);
+	if (!d->display) {
+		fb_destroy(d->fb);
+		return;
+	}
+	image_deinit(d);
+	if (d->bg_pixmap)
+		XFreePixmap(d->display, d->bg_pixmap);
+	if (d->put)
+		XDestroyImage(d->put);
+	free(d->segs);
+	free(d->xsegs);
+	if (d->pixmap)
+		XFreePixmap(d->display, d->pixmap);
+	if (d->font)
+		XUnloadFont(d->display, d->font->fid);
 	XFreeGC(d->display, d->gc);
 	XCloseDisplay(d->display);
 }
@@ -282,7 +671,33 @@ void dbx_run(int argc, char *argv[], struct dbx_ops *ops, u32 t_ms)
 {
 	struct dbx d;
 
-	dbx_init(&d, argc, argv);
+	memset(&d, 0, sizeof(d));
+	if (dbx_init(&d, argc, argv))
+		return;
+	dbx_loop(&d, ops, t_ms);
+	dbx_deinit(&d);
+}
+
+void dbx_run_headless(struct dbx_headless *h, struct dbx_ops *ops, u32 t_ms)
+{
+	struct dbx d;
+
+	memset(&d, 0, sizeof(d));
+	d.width = h->width;
+	d.height = h->height;
+	d.dump = h->dump;
+	if (d.dump && !dump_name_ok(d.dump)) {
+		printf("%s: only one %%d (and %%%%) allowed\n", d.dump);
+		return;
+	}
+	d.max_frames = h->frames;
+	d.fb = fb_create(d.width, d.height);
+	if (!d.fb) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		return;
+	}
+	printf("headless %dx%d%s%s\n", d.width, d.height,
+	       d.dump ? " dumping to " : "", d.dump ? d.dump : "");
 	dbx_loop(&d, ops, t_ms);
 	dbx_deinit(&d);
 }
@@ -298,36 +713,58 @@ static void color_init(XColor *c, u32 v)
 	c->flags = DoRed | DoGreen | DoBlue;
 }
 
-static unsigned long rgb2pixel(struct dbx *d, u32 rgb)
+/* an 8 bit channel scaled to bits, replicating the top bits when widening */
+static unsigned long channel(u32 v, int bits)
 {
-	XColor *c;
-	int i;
-
-	if (!rgb)
-		return BlackPixel(d->display, d->screen);
-	if (rgb == RGB(255, 255, 255))
-		return WhitePixel(d->display, d->screen);
+	v &= 0xff;
+	if (bits <= 8)
+		return v >> (8 - bits);
+	return (v << (bits - 8)) | (v >> (16 - bits));
+}
 
-	for (i = 0; i < d->clr_cnt; i++)
-		if (d->rgbs[i] == rgb)
-			return d->colors[i].pixel;
+static unsigned long rgb2pixel_hashed(struct dbx *d, u32 rgb)
+{
+	struct clr_entry *e;
+	XColor c;
+	u32 h;
+
+	/* keep the probe chains short, forget everything at 3/4 load */
+	if (d->clr_cnt >= CLR_HASH * 3 / 4) {
+		memset(d->clr, 0, sizeof(d->clr));
+		d->clr_cnt = 0;
+	}
 
-	if (ARRAY_SIZE(d->colors) == d->clr_cnt + 1) {
-		printf("! color array size (%u)\n", tickcount_ms());
-		return WhitePixel(d->display, d->screen);
+	h = (rgb * 2654435761u) >> (32 - __builtin_ctz(CLR_HASH));
+	for ( ;; h = (h + 1) & (CLR_HASH - 1)) {
+		e = &d->clr[h];
+		if (!e->used)
+			break;
+		if (e->rgb == rgb)
+			return e->pixel;
 	}
 
-	c = &d->colors[d->clr_cnt];
-	d->rgbs[d->clr_cnt++] = rgb;
+	color_init(&c, rgb);
+	if (!XAllocColor(d->display, d->cm, &c)) {
+		/* colormap full: fall back to the 3-3-2 cube */
+		color_init(&c, rgb & 0xe0e0c0);
+		if (!XAllocColor(d->display, d->cm, &c))
+			c.pixel = WhitePixel(d->display, d->screen);
+	}
 
-	color_init(c, rgb);
-	if (!XAllocColor(d->display, d->cm, c))
-		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
-	else
-		printf("RGB %04x %04x %04x | %06lx\n", c->red, c->green, c->blue,
-			c->pixel);
+	d->clr_cnt++;
+	e->rgb = rgb;
+	e->used = 1;
+	e->pixel = c.pixel;
+	return c.pixel;
+}
 
-	return c->pixel;
+static unsigned long rgb2pixel(struct dbx *d, u32 rgb)
+{
+	if (d->truecolor)
+		return channel(rgb >> 16, d->bits[0]) << d->shift[0] |
+		       channel(rgb >> 8, d->bits[1]) << d->shift[1] |
+		       channel(rgb, d->bits[2]) << d->shift[2];
+	return rgb2pixel_hashed(d, rgb);
 }
 
 int dbx_set_foreground(struct dbx *d, u32 rgb)
@@ -347,6 +784,10 @@ int dbx_set_foreground(struct dbx *d, u32 rgb)
 
 int dbx_draw_rectangle(struct dbx *d, int x, int y, int wd, int ht, u32 rgb)
 {
+	if (d->fb) {
+		fb_draw_rectangle(d->fb, x, y, wd, ht, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	if (!XDrawRectangle(d->display, d->pixmap, d->gc, x, y, wd, ht))
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
@@ -356,6 +797,10 @@ int dbx_draw_rectangle(struct dbx *d, int x, int y, int wd, int ht, u32 rgb)
 int dbx_fill_rectangle(struct dbx *d, int x, int y, int wd, int ht,
 		    u32 rgb)
 {
+	if (d->fb) {
+		fb_fill_rectangle(d->fb, x, y, wd, ht, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	if (!XFillRectangle(d->display, d->pixmap, d->gc, x, y, wd, ht))
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
@@ -368,9 +813,61 @@ int dbx_blank_pixmap(struct dbx *d)
 	return 0;
 }
 
+/* runs ops->background with the drawing target switched to the layer */
+static int dbx_render_background(struct dbx *d)
+{
+	struct fb *fb = d->fb;
+	Pixmap pixmap = d->pixmap;
+
+	if (fb) {
+		if (!d->bg)
+			d->bg = fb_create(d->width, d->height);
+		if (!d->bg)
+			return -1;
+		d->fb = d->bg;
+	} else {
+		if (!d->bg_pixmap)
+			d->bg_pixmap = XCreatePixmap(d->display, d->win, d->width,
+						     d->height, d->depth);
+		d->pixmap = d->bg_pixmap;
+	}
+
+	d->ops->background(d);
+
+	d->fb = fb;
+	d->pixmap = pixmap;
+	d->bg_dirty = 0;
+	return 0;
+}
+
+int dbx_blit_background(struct dbx *d)
+{
+	if (!d->ops || !d->ops->background)
+		return dbx_blank_pixmap(d);
+
+	if (d->bg_dirty && dbx_render_background(d))
+		return -1;
+
+	if (d->fb)
+		fb_copy(d->fb, d->bg);
+	else
+		XCopyArea(d->display, d->bg_pixmap, d->pixmap, d->gc, 0, 0,
+			  d->width, d->height, 0, 0);
+	return 0;
+}
+
+void dbx_invalidate_background(struct dbx *d)
+{
+	d->bg_dirty = 1;
+}
+
 int dbx_draw_string(struct dbx *d, int x, int y, const char *s, size_t len,
 		    u32 rgb)
 {
+	if (d->fb) {
+		fb_draw_string(d->fb, x, y, s, len, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	if (XDrawString(d->display, d->pixmap, d->gc, x, y, s, len))
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
@@ -379,6 +876,10 @@ int dbx_draw_string(struct dbx *d, int x, int y, const char *s, size_t len,
 
 int dbx_fill_circle(struct dbx *d, int x, int y, int dia, u32 rgb)
 {
+	if (d->fb) {
+		fb_fill_circle(d->fb, x, y, dia, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	if (!XFillArc(d->display, d->pixmap, d->gc, x, y, dia, dia, 0, 360 * 64))
 		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
@@ -387,6 +888,10 @@ int dbx_fill_circle(struct dbx *d, int x, int y, int dia, u32 rgb)
 
 int dbx_draw_point(struct dbx *d, int x, int y, u32 rgb)
 {
+	if (d->fb) {
+		fb_draw_point(d->fb, x, y, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	XDrawPoint(d->display, d->pixmap, d->gc, x, y);
 	return 0;
@@ -394,6 +899,10 @@ int dbx_draw_point(struct dbx *d, int x, int y, u32 rgb)
 
 int dbx_draw_line(struct dbx *d, int x1, int y1, int x2, int y2, u32 rgb)
 {
+	if (d->fb) {
+		fb_draw_line(d->fb, x1, y1, x2, y2, rgb);
+		return 0;
+	}
 	dbx_set_foreground(d, rgb);
 	XDrawLine(d->display, d->pixmap, d->gc, x1, y1, x2, y2);
 	return 0;
@@ -408,3 +917,129 @@ int dbx_height(struct dbx *d)
 {
 	return d->height;
 }
+
+int dbx_draw_polyline(struct dbx *d, const XPoint *pts, int n, u32 rgb)
+{
+	int i;
+
+	if (d->fb) {
+		for (i = 1; i < n; i++)
+			fb_draw_line(d->fb, pts[i - 1].x, pts[i - 1].y,
+				     pts[i].x, pts[i].y, rgb);
+		return 0;
+	}
+
+	if (n < 2)
+		return 0;
+	dbx_set_foreground(d, rgb);
+	XDrawLines(d->display, d->pixmap, d->gc, (XPoint *)pts, n,
+		   CoordModeOrigin);
+	return 0;
+}
+
+static int segment_cmp(const void *a, const void *b)
+{
+	u32 ca = ((const struct dbx_segment *)a)->rgb;
+	u32 cb = ((const struct dbx_segment *)b)->rgb;
+
+	return ca < cb ? -1 : ca > cb;
+}
+
+int dbx_draw_segments(struct dbx *d, const struct dbx_segment *segs, int n)
+{
+	const struct dbx_segment *s;
+	int i, j;
+
+	if (d->fb) {
+		for (i = 0; i < n; i++)
+			fb_draw_line(d->fb, segs[i].x1, segs[i].y1,
+				     segs[i].x2, segs[i].y2, segs[i].rgb);
+		return 0;
+	}
+
+	if (n > d->segs_n) {
+		free(d->segs);
+		free(d->xsegs);
+		d->segs = malloc(sizeof(*d->segs) * n);
+		d->xsegs = malloc(sizeof(*d->xsegs) * n);
+		d->segs_n = d->segs && d->xsegs ? n : 0;
+		if (!d->segs_n) {
+			printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+			return -1;
+		}
+	}
+	memcpy(d->segs, segs, sizeof(*segs) * n);
+	qsort(d->segs, n, sizeof(*d->segs), segment_cmp);
+
+	for (i = 0; i < n; i = j) {
+		for (j = i; j < n && d->segs[j].rgb == d->segs[i].rgb; j++) {
+			s = &d->segs[j];
+			d->xsegs[j - i] = (XSegment){ s->x1, s->y1, s->x2, s->y2 };
+		}
+		dbx_set_foreground(d, d->segs[i].rgb);
+		XDrawSegments(d->display, d->pixmap, d->gc, d->xsegs, j - i);
+	}
+	return 0;
+}
+
+/* grows the scratch image dbx_draw_image() converts pixels into */
+static int put_reserve(struct dbx *d, int wd, int ht)
+{
+	XImage *im;
+	char *data;
+
+	if (d->put && d->put->width >= wd && d->put->height >= ht)
+		return 0;
+	if (d->put) {
+		wd = MAX(wd, d->put->width);
+		ht = MAX(ht, d->put->height);
+		XDestroyImage(d->put);
+		d->put = NULL;
+	}
+
+	im = XCreateImage(d->display, DefaultVisual(d->display, d->screen),
+			  d->depth, ZPixmap, 0, NULL, wd, ht, 32, 0);
+	if (!im)
+		return -1;
+	data = malloc(im->bytes_per_line * ht);
+	if (!data) {
+		XDestroyImage(im);
+		return -1;
+	}
+	im->data = data;
+	d->put = im;
+	return 0;
+}
+
+int dbx_draw_image(struct dbx *d, int x, int y, const u32 *px, int stride,
+		   int wd, int ht)
+{
+	int host = ((union { u16 s; u8 b; }){ .s = 1 }).b ? LSBFirst : MSBFirst;
+	u32 *row;
+	int i, j;
+
+	if (wd <= 0 || ht <= 0)
+		return 0;
+
+	if (d->fb) {
+		fb_blit(d->fb, x, y, px, stride, wd, ht);
+		return 0;
+	}
+
+	if (put_reserve(d, wd, ht)) {
+		printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+		return -1;
+	}
+	for (j = 0; j < ht; j++, px += stride) {
+		if (d->put->bits_per_pixel == 32 && d->put->byte_order == host) {
+			row = (u32 *)(d->put->data + j * d->put->bytes_per_line);
+			for (i = 0; i < wd; i++)
+				row[i] = rgb2pixel(d, px[i]);
+		} else {
+			for (i = 0; i < wd; i++)
+				XPutPixel(d->put, i, j, rgb2pixel(d, px[i]));
+		}
+	}
+	XPutImage(d->display, d->pixmap, d->gc, d->put, 0, 0, x, y, wd, ht);
+	return 0;
+}
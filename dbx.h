@@ -4,6 +4,7 @@
 #include <X11/Xutil.h>
 #include <X11/Xos.h>
 #include <X11/Xatom.h>
+#include <poll.h>
 #include <stdint.h>
 
 typedef uint32_t	u32;
@@ -33,20 +34,87 @@ struct dbx;
 struct dbx_ops {
 	int (*update)(struct dbx *);
 	int (*motion)(struct dbx *, XMotionEvent *);
+	/*
+	 * The window changed size: the drawing buffers already match
+	 * dbx_width() x dbx_height() and the background is invalidated.
+	 * Called once per burst of resizes, right before the next update.
+	 */
 	int (*configure)(struct dbx *, XConfigureEvent *);
 	int (*key)(struct dbx *, int , int , int );
 	int (*button)(struct dbx *, int button, int x, int y, int press);
+	/*
+	 * Extra descriptors polled next to the X connection: poll_fds fills
+	 * at most max entries once before the loop starts, poll_in is called
+	 * with the same array whenever any of them has revents set.
+	 */
+	int (*poll_fds)(struct dbx *, struct pollfd *pfd, int max);
+	int (*poll_in)(struct dbx *, struct pollfd *pfd, int n);
+	/*
+	 * Draws the static layer (axes, labels, ...) with the usual dbx_draw_*
+	 * calls, which land in a separate buffer; only called on the first
+	 * dbx_blit_background() after dbx_invalidate_background() or a resize.
+	 */
+	int (*background)(struct dbx *);
 };
 
+#define DBX_MAX_FDS	16
+
 void dbx_run(int argc, char *argv[], struct dbx_ops *ops, u32 t_ms);
 
+/*
+ * How dbx_run() draws: AUTO renders client-side and uploads each frame with
+ * one MIT-SHM put (XPutImage without SHM, IMAGE forces that), X issues
+ * every primitive to the server.  AUTO/IMAGE fall back to X on visuals the
+ * client-side framebuffer can't represent.
+ */
+enum {
+	DBX_RENDER_AUTO,
+	DBX_RENDER_IMAGE,
+	DBX_RENDER_X,
+};
+
+void dbx_set_render(int mode);
+
+/*
+ * No X server: draw into a width x height framebuffer, optionally written
+ * out after every frame (dump is a file name that may take the frame
+ * number, PPM unless it ends in .raw), stopping after frames when non-zero.
+ * Render time is reported every 100 frames and on exit.
+ */
+struct dbx_headless {
+	int width;
+	int height;
+	const char *dump;
+	int frames;
+};
+
+void dbx_run_headless(struct dbx_headless *h, struct dbx_ops *ops, u32 t_ms);
+
 int dbx_width(struct dbx *d);
 int dbx_height(struct dbx *d);
 
 int dbx_blank_pixmap(struct dbx *d);
+/* starts a frame from the cached background, blank without ops->background */
+int dbx_blit_background(struct dbx *d);
+void dbx_invalidate_background(struct dbx *d);
 int dbx_draw_rectangle(struct dbx *d, int x, int y, int wd, int ht, u32 rgb);
 int dbx_fill_rectangle(struct dbx *d, int x, int y, int wd, int ht, u32 rgb);
 int dbx_fill_circle(struct dbx *d, int x, int y, int dia, u32 rgb);
 int dbx_draw_string(struct dbx *d, int x, int y, const char *s, size_t len, u32 rgb);
 int dbx_draw_point(struct dbx *d, int x, int y, u32 rgb);
 int dbx_draw_line(struct dbx *d, int x1, int y1, int x2, int y2, u32 rgb);
+/* wd x ht RGB() pixels, stride apart; converted and put on the Xlib path */
+int dbx_draw_image(struct dbx *d, int x, int y, const u32 *px, int stride,
+		   int wd, int ht);
+
+/*
+ * Batched drawing, one request per call (per color for segments, which are
+ * grouped by color so the GC changes once per group) on the Xlib path.
+ */
+struct dbx_segment {
+	short x1, y1, x2, y2;
+	u32 rgb;
+};
+
+int dbx_draw_polyline(struct dbx *d, const XPoint *pts, int n, u32 rgb);
+int dbx_draw_segments(struct dbx *d, const struct dbx_segment *segs, int n);
@@ -0,0 +1,371 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <string.h>
+
+#include "dsp.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * log2 by exponent and mantissa: x = 2^e * m with m in [sqrt(1/2), sqrt(2)),
+ * log2(m) = 2 / ln(2) * atanh(y) with y = (m - 1) / (m + 1), |y| < 0.1716,
+ * and the series to y^7.  The first term left out, y^9 / 9, is below 2e-8
+ * so what is left is float rounding, under 1e-4 dB over the whole float
+ * range.  x must be positive and normal.
+ */
+#define LOG2_SQRT_HALF	0x3f3504f3
+#define LOG2_K		2.8853900818f		/* 2 / ln(2) */
+#define DB_LOG2		3.0102999566f		/* 10 * log10(2) */
+
+static inline float log2_1(float x)
+{
+	int32_t i, e;
+	float y, y2;
+
+	memcpy(&i, &x, sizeof(i));
+	e = (i - LOG2_SQRT_HALF) >> 23;
+	i -= e * (1 << 23);
+	memcpy(&x, &i, sizeof(x));
+	y = (x - 1.0f) / (x + 1.0f);
+	y2 = y * y;
+	return e + LOG2_K * y *
+	       (1.0f + y2 * (1.0f / 3 + y2 * (1.0f / 5 + y2 * (1.0f / 7))));
+}
+
+#if defined(__SSE2__)
+static inline __m128 log2_4(__m128 x)
+{
+	__m128i i = _mm_castps_si128(x), e;
+	__m128 one = _mm_set1_ps(1.0f), y, y2, p;
+
+	e = _mm_srai_epi32(_mm_sub_epi32(i, _mm_set1_epi32(LOG2_SQRT_HALF)), 23);
+	x = _mm_castsi128_ps(_mm_sub_epi32(i, _mm_slli_epi32(e, 23)));
+	y = _mm_div_ps(_mm_sub_ps(x, one), _mm_add_ps(x, one));
+	y2 = _mm_mul_ps(y, y);
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 5), _mm_mul_ps(y2, _mm_set1_ps(1.0f / 7)));
+	p = _mm_add_ps(_mm_set1_ps(1.0f / 3), _mm_mul_ps(y2, p));
+	p = _mm_add_ps(one, _mm_mul_ps(y2, p));
+	p = _mm_mul_ps(_mm_mul_ps(p, y), _mm_set1_ps(LOG2_K));
+	return _mm_add_ps(_mm_cvtepi32_ps(e), p);
+}
+
+/* 10 * log10 of p, floored at lo (a power) and capped at hi (in dB) */
+static inline __m128 db_4(__m128 p, __m128 lo, __m128 hi)
+{
+	return _mm_min_ps(_mm_mul_ps(log2_4(_mm_max_ps(p, lo)),
+				     _mm_set1_ps(DB_LOG2)), hi);
+}
+#elif defined(__ARM_NEON)
+static inline float32x4_t log2_4(float32x4_t x)
+{
+	int32x4_t i = vreinterpretq_s32_f32(x), e;
+	float32x4_t one = vdupq_n_f32(1.0f), y, y2, p, d, r;
+
+	e = vshrq_n_s32(vsubq_s32(i, vdupq_n_s32(LOG2_SQRT_HALF)), 23);
+	x = vreinterpretq_f32_s32(vsubq_s32(i, vshlq_n_s32(e, 23)));
+	/* no divide on 32 bit arm, two Newton steps on the estimate */
+	d = vaddq_f32(x, one);
+	r = vrecpeq_f32(d);
+	r = vmulq_f32(r, vrecpsq_f32(d, r));
+	r = vmulq_f32(r, vrecpsq_f32(d, r));
+	y = vmulq_f32(vsubq_f32(x, one), r);
+	y2 = vmulq_f32(y, y);
+	p = vmlaq_f32(vdupq_n_f32(1.0f / 5), y2, vdupq_n_f32(1.0f / 7));
+	p = vmlaq_f32(vdupq_n_f32(1.0f / 3), y2, p);
+	p = vmlaq_f32(one, y2, p);
+	p = vmulq_f32(vmulq_f32(p, y), vdupq_n_f32(LOG2_K));
+	return vaddq_f32(vcvtq_f32_s32(e), p);
+}
+
+static inline float32x4_t db_4(float32x4_t p, float32x4_t lo, float32x4_t hi)
+{
+	return vminq_f32(vmulq_f32(log2_4(vmaxq_f32(p, lo)),
+				   vdupq_n_f32(DB_LOG2)), hi);
+}
+#endif
+
+static inline float db_1(float p, float lo, float hi)
+{
+	p = DB_LOG2 * log2_1(p > lo ? p : lo);
+	return p < hi ? p : hi;
+}
+
+float dsp_s16_window(float *dst, const int16_t *src, const float *win, int n,
+		     float scale, float dc)
+{
+	float sum = 0.0f, x;
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 vs = _mm_set1_ps(scale), vdc = _mm_set1_ps(dc);
+	__m128 acc = _mm_setzero_ps(), lo, hi;
+	__m128i v;
+	float t[4];
+
+	for (; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *)&src[i]);
+		lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+		hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+		lo = _mm_mul_ps(lo, vs);
+		hi = _mm_mul_ps(hi, vs);
+		acc = _mm_add_ps(acc, _mm_add_ps(lo, hi));
+		_mm_store_ps(&dst[i], _mm_mul_ps(_mm_sub_ps(lo, vdc),
+						 _mm_load_ps(&win[i])));
+		_mm_store_ps(&dst[i + 4], _mm_mul_ps(_mm_sub_ps(hi, vdc),
+						     _mm_load_ps(&win[i + 4])));
+	}
+	_mm_storeu_ps(t, acc);
+	sum = t[0] + t[1] + t[2] + t[3];
+#elif defined(__ARM_NEON)
+	float32x4_t vs = vdupq_n_f32(scale), vdc = vdupq_n_f32(dc);
+	float32x4_t acc = vdupq_n_f32(0.0f), lo, hi;
+	int16x8_t v;
+
+	for (; i + 8 <= n; i += 8) {
+		v = vld1q_s16(&src[i]);
+		lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), vs);
+		hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), vs);
+		acc = vaddq_f32(acc, vaddq_f32(lo, hi));
+		vst1q_f32(&dst[i], vmulq_f32(vsubq_f32(lo, vdc), vld1q_f32(&win[i])));
+		vst1q_f32(&dst[i + 4], vmulq_f32(vsubq_f32(hi, vdc),
+						 vld1q_f32(&win[i + 4])));
+	}
+	sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1) +
+	      vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+
+	for (; i < n; i++) {
+		x = src[i] * scale;
+		sum += x;
+		dst[i] = (x - dc) * win[i];
+	}
+	return sum;
+}
+
+void dsp_s16_minmax(const int16_t *src, int n, int block, int16_t *min,
+		    int16_t *max, float *sq)
+{
+	const int16_t *x;
+	int16_t lo, hi;
+	float acc;
+	int b, i;
+
+	for (b = 0; b + block <= n; b += block) {
+		x = src + b;
+		lo = INT16_MAX;
+		hi = INT16_MIN;
+		acc = 0.0f;
+		i = 0;
+#if defined(__SSE2__)
+		if (block >= 8) {
+			__m128i vlo = _mm_set1_epi16(INT16_MAX);
+			__m128i vhi = _mm_set1_epi16(INT16_MIN), v;
+			__m128 vacc = _mm_setzero_ps(), fl, fh;
+			float t[4];
+
+			for (; i + 8 <= block; i += 8) {
+				v = _mm_loadu_si128((const __m128i *)&x[i]);
+				vlo = _mm_min_epi16(vlo, v);
+				vhi = _mm_max_epi16(vhi, v);
+				fl = _mm_cvtepi32_ps(_mm_srai_epi32(
+					_mm_unpacklo_epi16(v, v), 16));
+				fh = _mm_cvtepi32_ps(_mm_srai_epi32(
+					_mm_unpackhi_epi16(v, v), 16));
+				vacc = _mm_add_ps(vacc, _mm_add_ps(
+					_mm_mul_ps(fl, fl), _mm_mul_ps(fh, fh)));
+			}
+			/* fold the 8 lanes down to lane 0 */
+			vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 8));
+			vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 4));
+			vlo = _mm_min_epi16(vlo, _mm_srli_si128(vlo, 2));
+			vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 8));
+			vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 4));
+			vhi = _mm_max_epi16(vhi, _mm_srli_si128(vhi, 2));
+			lo = (int16_t)_mm_extract_epi16(vlo, 0);
+			hi = (int16_t)_mm_extract_epi16(vhi, 0);
+			_mm_storeu_ps(t, vacc);
+			acc = t[0] + t[1] + t[2] + t[3];
+		}
+#elif defined(__ARM_NEON)
+		if (block >= 8) {
+			int16x8_t vlo = vdupq_n_s16(INT16_MAX);
+			int16x8_t vhi = vdupq_n_s16(INT16_MIN), v;
+			float32x4_t vacc = vdupq_n_f32(0.0f), fl, fh;
+			int16x4_t l4, h4;
+
+			for (; i + 8 <= block; i += 8) {
+				v = vld1q_s16(&x[i]);
+				vlo = vminq_s16(vlo, v);
+				vhi = vmaxq_s16(vhi, v);
+				fl = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+				fh = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+				vacc = vmlaq_f32(vacc, fl, fl);
+				vacc = vmlaq_f32(vacc, fh, fh);
+			}
+			/* pairwise folds, vminv is aarch64 only */
+			l4 = vmin_s16(vget_low_s16(vlo), vget_high_s16(vlo));
+			l4 = vpmin_s16(l4, l4);
+			l4 = vpmin_s16(l4, l4);
+			h4 = vmax_s16(vget_low_s16(vhi), vget_high_s16(vhi));
+			h4 = vpmax_s16(h4, h4);
+			h4 = vpmax_s16(h4, h4);
+			lo = vget_lane_s16(l4, 0);
+			hi = vget_lane_s16(h4, 0);
+			acc = vgetq_lane_f32(vacc, 0) + vgetq_lane_f32(vacc, 1) +
+			      vgetq_lane_f32(vacc, 2) + vgetq_lane_f32(vacc, 3);
+		}
+#endif
+		for (; i < block; i++) {
+			lo = x[i] < lo ? x[i] : lo;
+			hi = x[i] > hi ? x[i] : hi;
+			acc += (float)x[i] * x[i];
+		}
+		min[b / block] = lo;
+		max[b / block] = hi;
+		sq[b / block] = acc;
+	}
+}
+
+float dsp_max_ranges(const float *x, const int *lo, const int *hi, int n,
+		     float *out)
+{
+	float m, top = -INFINITY;
+	int i, k, e;
+
+	for (i = 0; i < n; i++) {
+		k = lo[i];
+		e = hi[i];
+		m = x[k++];
+#if defined(__SSE2__)
+		if (e - k >= 4) {
+			__m128 v = _mm_set1_ps(m);
+
+			for (; k + 4 <= e; k += 4)
+				v = _mm_max_ps(v, _mm_loadu_ps(&x[k]));
+			v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+			v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+			m = _mm_cvtss_f32(v);
+		}
+#elif defined(__ARM_NEON)
+		if (e - k >= 4) {
+			float32x4_t v = vdupq_n_f32(m);
+			float32x2_t h;
+
+			for (; k + 4 <= e; k += 4)
+				v = vmaxq_f32(v, vld1q_f32(&x[k]));
+			h = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+			h = vpmax_f32(h, h);
+			m = vget_lane_f32(h, 0);
+		}
+#endif
+		for (; k < e; k++)
+			m = x[k] > m ? x[k] : m;
+		out[i] = m;
+		top = m > top ? m : top;
+	}
+	return top;
+}
+
+void dsp_power_db(const float *c, const float *norm, int n, float *pw,
+		  float *db, float floor, float ceil)
+{
+	float lo = powf(10.0f, floor / 10), p;
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(ceil), a, b, v;
+
+	for (; i + 4 <= n; i += 4) {
+		a = _mm_loadu_ps(&c[2 * i]);
+		b = _mm_loadu_ps(&c[2 * i + 4]);
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		/* re^2 + im^2 of the four bins */
+		v = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+			       _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		v = _mm_mul_ps(v, _mm_loadu_ps(&norm[i]));
+		_mm_storeu_ps(&pw[i], v);
+		_mm_storeu_ps(&db[i], db_4(v, vlo, vhi));
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t vlo = vdupq_n_f32(lo), vhi = vdupq_n_f32(ceil), v;
+	float32x4x2_t z;
+
+	for (; i + 4 <= n; i += 4) {
+		z = vld2q_f32(&c[2 * i]);
+		v = vmlaq_f32(vmulq_f32(z.val[0], z.val[0]), z.val[1], z.val[1]);
+		v = vmulq_f32(v, vld1q_f32(&norm[i]));
+		vst1q_f32(&pw[i], v);
+		vst1q_f32(&db[i], db_4(v, vlo, vhi));
+	}
+#endif
+
+	for (; i < n; i++) {
+		p = (c[2 * i] * c[2 * i] + c[2 * i + 1] * c[2 * i + 1]) * norm[i];
+		pw[i] = p;
+		db[i] = db_1(p, lo, ceil);
+	}
+}
+
+void dsp_db(const float *p, int n, float *db, float floor, float ceil)
+{
+	float lo = powf(10.0f, floor / 10);
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(ceil);
+
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(&db[i], db_4(_mm_loadu_ps(&p[i]), vlo, vhi));
+#elif defined(__ARM_NEON)
+	float32x4_t vlo = vdupq_n_f32(lo), vhi = vdupq_n_f32(ceil);
+
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(&db[i], db_4(vld1q_f32(&p[i]), vlo, vhi));
+#endif
+
+	for (; i < n; i++)
+		db[i] = db_1(p[i], lo, ceil);
+}
+
+void dsp_avg_peak(float *avg, float *peak, const float *x, int n, float a,
+		  float b, float decay)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vd = _mm_set1_ps(decay);
+	__m128 v;
+
+	for (; i + 4 <= n; i += 4) {
+		v = _mm_loadu_ps(&x[i]);
+		_mm_storeu_ps(&avg[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&avg[i]), va),
+						  _mm_mul_ps(v, vb)));
+		if (peak)
+			_mm_storeu_ps(&peak[i], _mm_max_ps(v, _mm_mul_ps(
+					_mm_loadu_ps(&peak[i]), vd)));
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t vd = vdupq_n_f32(decay), v;
+
+	for (; i + 4 <= n; i += 4) {
+		v = vld1q_f32(&x[i]);
+		vst1q_f32(&avg[i], vmlaq_n_f32(vmulq_n_f32(v, b),
+					       vld1q_f32(&avg[i]), a));
+		if (peak)
+			vst1q_f32(&peak[i], vmaxq_f32(v, vmulq_f32(
+					vld1q_f32(&peak[i]), vd)));
+	}
+#endif
+
+	for (; i < n; i++) {
+		avg[i] = avg[i] * a + x[i] * b;
+		if (peak)
+			peak[i] = x[i] > peak[i] * decay ? x[i] : peak[i] * decay;
+	}
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+/*
+ * Vector kernels for the analysis path, SSE2 or NEON when the build target
+ * has them (both are baseline on x86-64 / aarch64), plain C otherwise.
+ */
+
+/*
+ * dst[i] = (src[i] * scale - dc) * win[i] in one pass; returns the sum of
+ * src[i] * scale so the caller can track dc.  dst and win must be 16 byte
+ * aligned, src need not be.
+ */
+float dsp_s16_window(float *dst, const int16_t *src, const float *win, int n,
+		     float scale, float dc);
+
+/*
+ * Summaries of consecutive blocks of block samples, n / block of them:
+ * min[], max[] and the sum of squares sq[], one pass over src.  Any
+ * partial block at the end is left out.
+ */
+void dsp_s16_minmax(const int16_t *src, int n, int block, int16_t *min,
+		    int16_t *max, float *sq);
+
+/*
+ * out[i] = max of x[lo[i], hi[i]) for n ranges, hi[i] > lo[i]; returns the
+ * largest of them all, so a plot gets its columns and its scale in one
+ * pass.
+ */
+float dsp_max_ranges(const float *x, const int *lo, const int *hi, int n,
+		     float *out);
+
+/*
+ * Power spectrum of n interleaved re, im pairs c[]: pw[i] = |c[i]|^2 *
+ * norm[i], and db[i] = 10 * log10(pw[i]) limited to [floor, ceil], from
+ * one read of c.  The log is a vector approximation good to 1e-4 dB.
+ */
+void dsp_power_db(const float *c, const float *norm, int n, float *pw,
+		  float *db, float floor, float ceil);
+
+/* just the dB half of dsp_power_db(), db may be p */
+void dsp_db(const float *p, int n, float *db, float floor, float ceil);
+
+/*
+ * avg[i] = avg[i] * a + x[i] * b and, unless peak is NULL, peak[i] = the
+ * larger of x[i] and peak[i] * decay, one pass for a running average and
+ * a decaying peak hold.
+ */
+void dsp_avg_peak(float *avg, float *peak, const float *x, int n, float a,
+		  float b, float decay);
+
+#endif /* DSP_H */
@@ -0,0 +1,279 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fb.h"
+#include "font5x7.h"
+
+#define MIN(x, y)	(((x) < (y)) ? (x) : (y))
+#define MAX(x, y)	(((x) > (y)) ? (x) : (y))
+
+struct fb *fb_create(int width, int height)
+{
+	struct fb *fb;
+
+	fb = calloc(1, sizeof(*fb));
+	if (!fb)
+		return NULL;
+	fb->width = width;
+	fb->height = height;
+	fb->stride = width;
+	fb->own = 1;
+	fb->px = calloc((size_t)width * height, sizeof(*fb->px));
+	if (!fb->px) {
+		free(fb);
+		return NULL;
+	}
+	return fb;
+}
+
+struct fb *fb_wrap(uint32_t *px, int width, int height, int stride)
+{
+	struct fb *fb;
+
+	fb = calloc(1, sizeof(*fb));
+	if (!fb)
+		return NULL;
+	fb->px = px;
+	fb->width = width;
+	fb->height = height;
+	fb->stride = stride;
+	return fb;
+}
+
+void fb_destroy(struct fb *fb)
+{
+	if (!fb)
+		return;
+	if (fb->own)
+		free(fb->px);
+	free(fb);
+}
+
+void fb_copy(struct fb *dst, const struct fb *src)
+{
+	int w = MIN(dst->width, src->width);
+	int h = MIN(dst->height, src->height);
+	int y;
+
+	for (y = 0; y < h; y++)
+		memcpy(&dst->px[(size_t)y * dst->stride],
+		       &src->px[(size_t)y * src->stride], sizeof(*dst->px) * w);
+}
+
+void fb_blit(struct fb *fb, int x, int y, const uint32_t *px, int stride,
+	     int wd, int ht)
+{
+	int x1 = MAX(x, 0), y1 = MAX(y, 0);
+	int x2 = MIN(x + wd, fb->width), y2 = MIN(y + ht, fb->height);
+
+	if (x1 >= x2)
+		return;
+	for (; y1 < y2; y1++)
+		memcpy(&fb->px[(size_t)y1 * fb->stride + x1],
+		       &px[(size_t)(y1 - y) * stride + x1 - x],
+		       sizeof(*px) * (x2 - x1));
+}
+
+/* x1 inclusive, x2 exclusive, already clipped */
+static void hspan(struct fb *fb, int x1, int x2, int y, uint32_t rgb)
+{
+	uint32_t *p = &fb->px[(size_t)y * fb->stride];
+
+	for ( ; x1 < x2; x1++)
+		p[x1] = rgb;
+}
+
+void fb_fill_rectangle(struct fb *fb, int x, int y, int wd, int ht, uint32_t rgb)
+{
+	int x2 = x + wd, y2 = y + ht;
+
+	if (x < 0)
+		x = 0;
+	if (y < 0)
+		y = 0;
+	if (x2 > fb->width)
+		x2 = fb->width;
+	if (y2 > fb->height)
+		y2 = fb->height;
+
+	for ( ; y < y2; y++)
+		hspan(fb, x, x2, y, rgb);
+}
+
+void fb_draw_rectangle(struct fb *fb, int x, int y, int wd, int ht, uint32_t rgb)
+{
+	fb_fill_rectangle(fb, x, y, wd + 1, 1, rgb);
+	fb_fill_rectangle(fb, x, y + ht, wd + 1, 1, rgb);
+	fb_fill_rectangle(fb, x, y + 1, 1, ht - 1, rgb);
+	fb_fill_rectangle(fb, x + wd, y + 1, 1, ht - 1, rgb);
+}
+
+void fb_draw_point(struct fb *fb, int x, int y, uint32_t rgb)
+{
+	if ((unsigned)x < (unsigned)fb->width && (unsigned)y < (unsigned)fb->height)
+		fb->px[(size_t)y * fb->stride + x] = rgb;
+}
+
+/* Cohen-Sutherland outcode against the framebuffer */
+static int outcode(struct fb *fb, int x, int y)
+{
+	return (x < 0) | (x >= fb->width) << 1 |
+	       (y < 0) << 2 | (y >= fb->height) << 3;
+}
+
+static int clip_line(struct fb *fb, int *x1, int *y1, int *x2, int *y2)
+{
+	int c1 = outcode(fb, *x1, *y1), c2 = outcode(fb, *x2, *y2);
+	long long dx, dy;
+	int c, x, y;
+
+	while (c1 | c2) {
+		if (c1 & c2)
+			return 0;
+
+		c = c1 ? c1 : c2;
+		dx = *x2 - *x1;
+		dy = *y2 - *y1;
+		if (c & 1) {
+			x = 0;
+			y = *y1 + dy * (x - *x1) / dx;
+		} else if (c & 2) {
+			x = fb->width - 1;
+			y = *y1 + dy * (x - *x1) / dx;
+		} else if (c & 4) {
+			y = 0;
+			x = *x1 + dx * (y - *y1) / dy;
+		} else {
+			y = fb->height - 1;
+			x = *x1 + dx * (y - *y1) / dy;
+		}
+
+		if (c == c1) {
+			*x1 = x;
+			*y1 = y;
+			c1 = outcode(fb, x, y);
+		} else {
+			*x2 = x;
+			*y2 = y;
+			c2 = outcode(fb, x, y);
+		}
+	}
+	return 1;
+}
+
+void fb_draw_line(struct fb *fb, int x1, int y1, int x2, int y2, uint32_t rgb)
+{
+	int dx, dy, sx, sy, err, e2;
+	uint32_t *p;
+
+	if (!clip_line(fb, &x1, &y1, &x2, &y2))
+		return;
+
+	if (y1 == y2) {
+		hspan(fb, x1 < x2 ? x1 : x2, (x1 < x2 ? x2 : x1) + 1, y1, rgb);
+		return;
+	}
+
+	dx = x2 > x1 ? x2 - x1 : x1 - x2;
+	dy = y2 > y1 ? y1 - y2 : y2 - y1;
+	sx = x1 < x2 ? 1 : -1;
+	sy = y1 < y2 ? fb->stride : -fb->stride;
+	err = dx + dy;
+	p = &fb->px[(size_t)y1 * fb->stride + x1];
+
+	for ( ;; ) {
+		*p = rgb;
+		if (x1 == x2 && p == &fb->px[(size_t)y2 * fb->stride + x2])
+			break;
+		e2 = 2 * err;
+		if (e2 >= dy) {
+			err += dy;
+			x1 += sx;
+			p += sx;
+		}
+		if (e2 <= dx) {
+			err += dx;
+			p += sy;
+		}
+	}
+}
+
+void fb_fill_circle(struct fb *fb, int x, int y, int dia, uint32_t rgb)
+{
+	/* in half pixels, so pixel centres and even diameters stay exact */
+	int cx = 2 * x + dia, cy = 2 * y + dia, r2 = dia * dia;
+	int row, dy, hw, x1, x2;
+
+	for (row = MAX(y, 0); row < MIN(y + dia, fb->height); row++) {
+		dy = 2 * row + 1 - cy;
+		if (dy * dy > r2)
+			continue;
+		hw = sqrtf(r2 - dy * dy);
+		/* columns with |2 * col + 1 - cx| <= hw */
+		x1 = (cx - hw) / 2;
+		x2 = (cx + hw + 1) / 2;
+		hspan(fb, MAX(x1, 0), MIN(x2, fb->width), row, rgb);
+	}
+}
+
+void fb_draw_string(struct fb *fb, int x, int y, const char *s, size_t len,
+		    uint32_t rgb)
+{
+	const unsigned char *g;
+	int i, j;
+
+	for ( ; len--; s++, x += FONT_W + 1) {
+		if (*s < FONT_FIRST || *s > FONT_LAST)
+			continue;
+		g = font5x7[*s - FONT_FIRST];
+		for (i = 0; i < FONT_H; i++)
+			for (j = 0; j < FONT_W; j++)
+				if (g[i] & (0x10 >> j))
+					fb_draw_point(fb, x + j, y - FONT_H + i, rgb);
+	}
+}
+
+int fb_write(struct fb *fb, const char *path)
+{
+	size_t n = strlen(path);
+	unsigned char *row;
+	uint32_t v;
+	FILE *f;
+	int x, y;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (n > 4 && !strcmp(path + n - 4, ".raw")) {
+		for (y = 0; y < fb->height; y++)
+			fwrite(&fb->px[(size_t)y * fb->stride], sizeof(*fb->px),
+			       fb->width, f);
+		return fclose(f);
+	}
+
+	row = malloc(3 * fb->width);
+	if (!row) {
+		fclose(f);
+		return -1;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", fb->width, fb->height);
+	for (y = 0; y < fb->height; y++) {
+		for (x = 0; x < fb->width; x++) {
+			v = fb->px[(size_t)y * fb->stride + x];
+			row[3 * x + 0] = v >> 16;
+			row[3 * x + 1] = v >> 8;
+			row[3 * x + 2] = v;
+		}
+		fwrite(row, 3, fb->width, f);
+	}
+	free(row);
+	return fclose(f);
+}
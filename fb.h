@@ -0,0 +1,47 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef FB_H
+#define FB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Client-side 32 bit framebuffer, pixels are 0x00RRGGBB (the dbx RGB()
+ * value), which is also the byte order of a little-endian 24/32 bit
+ * TrueColor XImage.  Primitives follow the Xlib calls they replace:
+ * rectangle outlines cover wd + 1 x ht + 1 pixels, circles are given by
+ * their bounding box and strings by their baseline.  Everything is clipped.
+ */
+struct fb {
+	uint32_t *px;
+	int width;
+	int height;
+	int stride;		/* pixels per row */
+	int own;		/* px was allocated by fb_create() */
+};
+
+struct fb *fb_create(int width, int height);
+/* draws into the caller's pixels, e.g. an XImage, which fb_destroy() keeps */
+struct fb *fb_wrap(uint32_t *px, int width, int height, int stride);
+void fb_destroy(struct fb *fb);
+
+/* src over dst where they overlap, e.g. a pre-rendered background */
+void fb_copy(struct fb *dst, const struct fb *src);
+
+/* wd x ht pixels, stride apart, to x, y */
+void fb_blit(struct fb *fb, int x, int y, const uint32_t *px, int stride,
+	     int wd, int ht);
+
+void fb_fill_rectangle(struct fb *fb, int x, int y, int wd, int ht, uint32_t rgb);
+void fb_draw_rectangle(struct fb *fb, int x, int y, int wd, int ht, uint32_t rgb);
+void fb_draw_point(struct fb *fb, int x, int y, uint32_t rgb);
+void fb_draw_line(struct fb *fb, int x1, int y1, int x2, int y2, uint32_t rgb);
+void fb_fill_circle(struct fb *fb, int x, int y, int dia, uint32_t rgb);
+void fb_draw_string(struct fb *fb, int x, int y, const char *s, size_t len,
+		    uint32_t rgb);
+
+/* binary PPM (P6), or the pixels as they are in memory for .raw */
+int fb_write(struct fb *fb, const char *path);
+
+#endif /* FB_H */
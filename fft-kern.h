@@ -0,0 +1,118 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+/*
+ * FFT pass template, included once per instruction set by fft-simd.c with
+ * KERN(), VEC, VW, VLD, VST, VADD, VSUB and VMUL defined.  No fused
+ * multiply-add: the scalar instance has to round exactly like the vector
+ * ones.
+ */
+
+static void KERN(r2)(float *re, float *im, int n, int h,
+		     const float *wr, const float *wi)
+{
+	VEC xr, xi, yr, yi, tr, ti, cr, ci;
+	float *ar, *ai, *br, *bi;
+	int i, m;
+
+	for (i = 0; i < n; i += 2 * h) {
+		ar = re + i;
+		ai = im + i;
+		br = ar + h;
+		bi = ai + h;
+		for (m = 0; m < h; m += VW) {
+			cr = VLD(wr + m);
+			ci = VLD(wi + m);
+			xr = VLD(ar + m);
+			xi = VLD(ai + m);
+			yr = VLD(br + m);
+			yi = VLD(bi + m);
+
+			tr = VSUB(VMUL(cr, yr), VMUL(ci, yi));
+			ti = VADD(VMUL(cr, yi), VMUL(ci, yr));
+
+			VST(ar + m, VADD(xr, tr));
+			VST(ai + m, VADD(xi, ti));
+			VST(br + m, VSUB(xr, tr));
+			VST(bi + m, VSUB(xi, ti));
+		}
+	}
+}
+
+/*
+ * x0..x3 at m, m+h, m+2h, m+3h; the second stage twiddle of the odd pair
+ * is wb[m+h] = -+i * wb[m], applied as a swap instead of a multiply
+ */
+static void KERN(r4)(float *re, float *im, int n, int h,
+		     const float *war, const float *wai,
+		     const float *wbr, const float *wbi, int inverse)
+{
+	VEC x0r, x0i, x1r, x1i, x2r, x2i, x3r, x3i;
+	VEC ar, ai, br, bi, tr, ti, ur, ui;
+	float *r, *j;
+	int i, m;
+
+	for (i = 0; i < n; i += 4 * h) {
+		r = re + i;
+		j = im + i;
+		for (m = 0; m < h; m += VW) {
+			ar = VLD(war + m);
+			ai = VLD(wai + m);
+			x0r = VLD(r + m);
+			x0i = VLD(j + m);
+			x1r = VLD(r + m + h);
+			x1i = VLD(j + m + h);
+			x2r = VLD(r + m + 2 * h);
+			x2i = VLD(j + m + 2 * h);
+			x3r = VLD(r + m + 3 * h);
+			x3i = VLD(j + m + 3 * h);
+
+			/* first stage, half length h */
+			tr = VSUB(VMUL(ar, x1r), VMUL(ai, x1i));
+			ti = VADD(VMUL(ar, x1i), VMUL(ai, x1r));
+			x1r = VSUB(x0r, tr);
+			x1i = VSUB(x0i, ti);
+			x0r = VADD(x0r, tr);
+			x0i = VADD(x0i, ti);
+
+			tr = VSUB(VMUL(ar, x3r), VMUL(ai, x3i));
+			ti = VADD(VMUL(ar, x3i), VMUL(ai, x3r));
+			x3r = VSUB(x2r, tr);
+			x3i = VSUB(x2i, ti);
+			x2r = VADD(x2r, tr);
+			x2i = VADD(x2i, ti);
+
+			/* second stage, half length 2h */
+			br = VLD(wbr + m);
+			bi = VLD(wbi + m);
+			tr = VSUB(VMUL(br, x2r), VMUL(bi, x2i));
+			ti = VADD(VMUL(br, x2i), VMUL(bi, x2r));
+			ur = VSUB(VMUL(br, x3r), VMUL(bi, x3i));
+			ui = VADD(VMUL(br, x3i), VMUL(bi, x3r));
+
+			VST(r + m, VADD(x0r, tr));
+			VST(j + m, VADD(x0i, ti));
+			VST(r + m + 2 * h, VSUB(x0r, tr));
+			VST(j + m + 2 * h, VSUB(x0i, ti));
+			if (inverse) {
+				VST(r + m + h, VSUB(x1r, ui));
+				VST(j + m + h, VADD(x1i, ur));
+				VST(r + m + 3 * h, VADD(x1r, ui));
+				VST(j + m + 3 * h, VSUB(x1i, ur));
+			} else {
+				VST(r + m + h, VADD(x1r, ui));
+				VST(j + m + h, VSUB(x1i, ur));
+				VST(r + m + 3 * h, VSUB(x1r, ui));
+				VST(j + m + 3 * h, VADD(x1i, ur));
+			}
+		}
+	}
+}
+
+#undef KERN
+#undef VEC
+#undef VW
+#undef VLD
+#undef VST
+#undef VADD
+#undef VSUB
+#undef VMUL
@@ -0,0 +1,177 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <string.h>
+
+#include "fft.h"
+#include "fft-simd.h"
+
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+
+#define KERN(x)		scalar_##x
+#define VEC		float
+#define VW		1
+#define VLD(p)		(*(p))
+#define VST(p, v)	(*(p) = (v))
+#define VADD(a, b)	((a) + (b))
+#define VSUB(a, b)	((a) - (b))
+#define VMUL(a, b)	((a) * (b))
+#include "fft-kern.h"
+
+const struct fft_kernels fft_kern_scalar = {
+	.name = "scalar", .width = 1, .r2 = scalar_r2, .r4 = scalar_r4,
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define KERN(x)		sse2_##x
+#define VEC		__m128
+#define VW		4
+#define VLD(p)		_mm_load_ps(p)
+#define VST(p, v)	_mm_store_ps(p, v)
+#define VADD(a, b)	_mm_add_ps(a, b)
+#define VSUB(a, b)	_mm_sub_ps(a, b)
+#define VMUL(a, b)	_mm_mul_ps(a, b)
+#include "fft-kern.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define KERN(x)		avx2_##x
+#define VEC		__m256
+#define VW		8
+#define VLD(p)		_mm256_load_ps(p)
+#define VST(p, v)	_mm256_store_ps(p, v)
+#define VADD(a, b)	_mm256_add_ps(a, b)
+#define VSUB(a, b)	_mm256_sub_ps(a, b)
+#define VMUL(a, b)	_mm256_mul_ps(a, b)
+#include "fft-kern.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define KERN(x)		avx512_##x
+#define VEC		__m512
+#define VW		16
+#define VLD(p)		_mm512_load_ps(p)
+#define VST(p, v)	_mm512_store_ps(p, v)
+#define VADD(a, b)	_mm512_add_ps(a, b)
+#define VSUB(a, b)	_mm512_sub_ps(a, b)
+#define VMUL(a, b)	_mm512_mul_ps(a, b)
+#include "fft-kern.h"
+#pragma GCC pop_options
+
+static const struct fft_kernels simd_kernels[] = {
+	{ "avx512", 16, avx512_r2, avx512_r4 },
+	{ "avx2",    8, avx2_r2,   avx2_r4   },
+	{ "sse2",    4, sse2_r2,   sse2_r4   },
+};
+
+static int simd_supported(const struct fft_kernels *k)
+{
+	__builtin_cpu_init();
+	if (!strcmp(k->name, "avx512"))
+		return __builtin_cpu_supports("avx512f");
+	if (!strcmp(k->name, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	return __builtin_cpu_supports("sse2");
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+#define KERN(x)		neon_##x
+#define VEC		float32x4_t
+#define VW		4
+#define VLD(p)		vld1q_f32(p)
+#define VST(p, v)	vst1q_f32(p, v)
+#define VADD(a, b)	vaddq_f32(a, b)
+#define VSUB(a, b)	vsubq_f32(a, b)
+#define VMUL(a, b)	vmulq_f32(a, b)
+#include "fft-kern.h"
+
+static const struct fft_kernels simd_kernels[] = {
+	{ "neon", 4, neon_r2, neon_r4 },
+};
+
+static int simd_supported(const struct fft_kernels *k)
+{
+	return 1;
+}
+#else
+static const struct fft_kernels simd_kernels[] = {
+	{ "scalar", 1, scalar_r2, scalar_r4 },
+};
+
+static int simd_supported(const struct fft_kernels *k)
+{
+	return 1;
+}
+#endif
+
+const struct fft_kernels *fft_kern;
+
+/* the selected set and every narrower supported one, widest first */
+static const struct fft_kernels *chain[ARRAY_SIZE(simd_kernels) + 1];
+
+static void select_kernels(const struct fft_kernels *k)
+{
+	int i, cnt = 0;
+
+	fft_kern = k;
+	for (i = 0; i < ARRAY_SIZE(simd_kernels); i++)
+		if (simd_kernels[i].width <= k->width &&
+		    simd_kernels[i].width > 1 && simd_supported(&simd_kernels[i]))
+			chain[cnt++] = &simd_kernels[i];
+	chain[cnt] = &fft_kern_scalar;
+}
+
+const struct fft_kernels *fft_kern_for(int h)
+{
+	const struct fft_kernels **k;
+
+	for (k = chain; (*k)->width > h; k++)
+		;
+	return *k;
+}
+
+/* widest instruction set the cpu has, probed once */
+void fft_simd_init(void)
+{
+	int i;
+
+	if (fft_kern)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(simd_kernels); i++)
+		if (simd_supported(&simd_kernels[i]))
+			break;
+	select_kernels(i < ARRAY_SIZE(simd_kernels) ? &simd_kernels[i]
+						    : &fft_kern_scalar);
+}
+
+const char *fft_isa(void)
+{
+	fft_simd_init();
+	return fft_kern->name;
+}
+
+int fft_set_isa(const char *name)
+{
+	int i;
+
+	fft_simd_init();
+	if (!strcmp(name, fft_kern_scalar.name)) {
+		select_kernels(&fft_kern_scalar);
+		return 0;
+	}
+	for (i = 0; i < ARRAY_SIZE(simd_kernels); i++) {
+		if (!strcmp(name, simd_kernels[i].name) &&
+		    simd_supported(&simd_kernels[i])) {
+			select_kernels(&simd_kernels[i]);
+			return 0;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,31 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef FFT_SIMD_H
+#define FFT_SIMD_H
+
+/*
+ * radix-2 FFT passes over split re[]/im[] arrays already in bit-reversed
+ * order; h is the half length of the (first) stage and the twiddles are
+ * e^(-+2*pi*i*m/2h), m < h.  r4 does the h and 2h stages in one pass.
+ * Every instruction set runs the same sequence of float operations, so
+ * results are bit identical to the scalar kernels.
+ */
+struct fft_kernels {
+	const char *name;
+	int width;		/* floats per vector, passes need h >= width */
+	void (*r2)(float *re, float *im, int n, int h,
+		   const float *wr, const float *wi);
+	void (*r4)(float *re, float *im, int n, int h,
+		   const float *war, const float *wai,
+		   const float *wbr, const float *wbi, int inverse);
+};
+
+extern const struct fft_kernels fft_kern_scalar;
+extern const struct fft_kernels *fft_kern;
+
+/* widest enabled kernels a pass of half length h can use */
+const struct fft_kernels *fft_kern_for(int h);
+
+void fft_simd_init(void);
+
+#endif /* FFT_SIMD_H */
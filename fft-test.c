@@ -1,14 +1,25 @@
 #include <assert.h>
+#include <float.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bands.h"
+#include "dsp.h"
+#include "fft.h"
+#include "psd.h"
+#include "ring.h"
+#include "stft.h"
+#include "wave.h"
 
 #define q	3		/* for 2^3 points */
 #define N	(1<<q)		/* N-point FFT, iFFT */
 
-typedef float real;
-typedef struct{real Re; real Im;} complex;
-
 #ifndef PI
 # define PI	3.14159265358979323846264338327950288
 #endif
@@ -24,95 +35,1062 @@ static void print_vector(const char *title, complex *x, int n)
 	return;
 }
 
+static void fft(complex *v, int n)
+{
+	fft_execute(fft_plan_get(n, FFT_FORWARD), v);
+}
+
+static void ifft(complex *v, int n)
+{
+	fft_execute(fft_plan_get(n, FFT_INVERSE), v);
+}
+
+/* direct O(n^2) transform in double precision, the reference */
+static void dft(const complex *v, int n, int dir, double *re, double *im)
+{
+	double s = dir == FFT_INVERSE ? 1.0 : -1.0;
+	double *c = malloc(sizeof(*c) * n);
+	double *sn = malloc(sizeof(*sn) * n);
+	int k, t, j;
+
+	assert(c && sn);
+	for (j = 0; j < n; j++) {
+		c[j] = cos(2 * PI * j / n);
+		sn[j] = s * sin(2 * PI * j / n);
+	}
+
+	for (k = 0; k < n; k++) {
+		re[k] = im[k] = 0.0;
+		for (t = 0, j = 0; t < n; t++, j = (j + k) % n) {
+			re[k] += v[t].Re * c[j] - v[t].Im * sn[j];
+			im[k] += v[t].Re * sn[j] + v[t].Im * c[j];
+		}
+		if (dir == FFT_INVERSE) {
+			re[k] /= n;
+			im[k] /= n;
+		}
+	}
+	free(c);
+	free(sn);
+}
+
+/* relative rms error of the plan against the direct transform */
+static double check_size(int n, int dir)
+{
+	double *re = malloc(sizeof(*re) * n);
+	double *im = malloc(sizeof(*im) * n);
+	complex *v = malloc(sizeof(*v) * n);
+	double err = 0.0, ref = 0.0, dr, di;
+	struct fft_plan *p;
+	int k;
+
+	assert(re && im && v);
+	srand(n);
+	for (k = 0; k < n; k++) {
+		v[k].Re = (float)rand() / RAND_MAX - 0.5f;
+		v[k].Im = (float)rand() / RAND_MAX - 0.5f;
+	}
+	dft(v, n, dir, re, im);
+
+	p = fft_plan_get(n, dir);
+	assert(p);
+	fft_execute(p, v);
+
+	for (k = 0; k < n; k++) {
+		dr = v[k].Re - re[k];
+		di = v[k].Im - im[k];
+		err += dr * dr + di * di;
+		ref += re[k] * re[k] + im[k] * im[k];
+	}
+	free(re);
+	free(im);
+	free(v);
+	return sqrt(err / ref);
+}
+
+/* real input plan against the direct transform of the same samples */
+static double check_real(int n)
+{
+	double *re = malloc(sizeof(*re) * n);
+	double *im = malloc(sizeof(*im) * n);
+	complex *v = malloc(sizeof(*v) * n);
+	double err = 0.0, ref = 0.0, dr, di;
+	struct fft_plan *p;
+	float *x;
+	int k;
+
+	assert(re && im && v);
+	p = fft_plan_get(n, FFT_REAL);
+	assert(p);
+	x = (float *)fft_plan_work(p);
+
+	srand(n);
+	for (k = 0; k < n; k++) {
+		v[k].Re = x[k] = (float)rand() / RAND_MAX - 0.5f;
+		v[k].Im = 0.0f;
+	}
+	dft(v, n, FFT_FORWARD, re, im);
+	fft_execute(p, fft_plan_work(p));
+
+	v = memcpy(v, fft_plan_work(p), sizeof(*v) * (n / 2 + 1));
+	for (k = 0; k < n / 2 + 1; k++) {
+		dr = v[k].Re - re[k];
+		di = v[k].Im - im[k];
+		err += dr * dr + di * di;
+		ref += re[k] * re[k] + im[k] * im[k];
+	}
+	free(re);
+	free(im);
+	free(v);
+	return sqrt(err / ref);
+}
+
 /*
-   fft(v,N):
-   [0] If N==1 then return.
-   [1] For k = 0 to N/2-1, let ve[k] = v[2*k]
-   [2] Compute fft(ve, N/2);
-   [3] For k = 0 to N/2-1, let vo[k] = v[2*k+1]
-   [4] Compute fft(vo, N/2);
-   [5] For m = 0 to N/2-1, do [6] through [9]
-   [6]   Let w.re = cos(2*PI*m/N)
-   [7]   Let w.im = -sin(2*PI*m/N)
-   [8]   Let v[m] = ve[m] + w*vo[m]
-   [9]   Let v[m+N/2] = ve[m] - w*vo[m]
+ * The iterative in-place radix 2 transform: an impulse at t comes out as
+ * the twiddle e^(-2 pi i k t / n) in every bin k, which only holds if the
+ * bit-reversal put it in the right place.  Running the cached plan again,
+ * on the caller's buffer or on its own work buffer, gives the same bits,
+ * and the inverse brings the input back.
  */
-void fft(complex *v, int n, complex *tmp)
-{
-  if(n>1) {			/* otherwise, do nothing and return */
-    int k,m;    complex z, w, *vo, *ve;
-    ve = tmp; vo = tmp+n/2;
-    for(k=0; k<n/2; k++) {
-      ve[k] = v[2*k];
-      vo[k] = v[2*k+1];
-    }
-    fft( ve, n/2, v );		/* FFT on even-indexed elements of v[] */
-    fft( vo, n/2, v );		/* FFT on odd-indexed elements of v[] */
-    for(m=0; m<n/2; m++) {
-      w.Re = cos(2*PI*m/(double)n);
-      w.Im = -sin(2*PI*m/(double)n);
-      z.Re = w.Re*vo[m].Re - w.Im*vo[m].Im;	/* Re(w*vo[m]) */
-      z.Im = w.Re*vo[m].Im + w.Im*vo[m].Re;	/* Im(w*vo[m]) */
-      v[  m  ].Re = ve[m].Re + z.Re;
-      v[  m  ].Im = ve[m].Im + z.Im;
-      v[m+n/2].Re = ve[m].Re - z.Re;
-      v[m+n/2].Im = ve[m].Im - z.Im;
-    }
-  }
+static int check_radix2(void)
+{
+	enum { MAXN = 4096 };
+	static complex v[MAXN], w[MAXN], x[MAXN];
+	double e, emax = 0.0, a;
+	struct fft_plan *fwd, *inv;
+	int n, t, k, step, fail = 0;
+
+	for (n = 2; n <= MAXN; n *= 2) {
+		fwd = fft_plan_get(n, FFT_FORWARD);
+		inv = fft_plan_get(n, FFT_INVERSE);
+		assert(fwd && inv);
+
+		step = n <= 64 ? 1 : n / 16 + 1;
+		for (t = 0; t < n; t += step) {
+			memset(v, 0, sizeof(*v) * n);
+			v[t].Re = 1.0f;
+			fft_execute(fwd, v);
+			for (k = 0; k < n; k++) {
+				a = -2 * PI * (double)k * t / n;
+				e = hypot(v[k].Re - cos(a), v[k].Im - sin(a));
+				emax = fmax(emax, e);
+			}
+		}
+
+		srand(n);
+		for (k = 0; k < n; k++) {
+			x[k].Re = (float)rand() / RAND_MAX - 0.5f;
+			x[k].Im = (float)rand() / RAND_MAX - 0.5f;
+		}
+		memcpy(v, x, sizeof(*v) * n);
+		memcpy(w, x, sizeof(*w) * n);
+		fft_execute(fwd, v);
+		fft_execute(fwd, w);
+		memcpy(fft_plan_work(fwd), x, sizeof(*x) * n);
+		fft_execute(fwd, fft_plan_work(fwd));
+		if (memcmp(v, w, sizeof(*v) * n) ||
+		    memcmp(v, fft_plan_work(fwd), sizeof(*v) * n)) {
+			printf("FAIL radix2 n=%d differs between runs\n", n);
+			fail = 1;
+		}
+
+		fft_execute(inv, v);
+		for (k = 0; k < n; k++)
+			emax = fmax(emax, hypot(v[k].Re - x[k].Re,
+						v[k].Im - x[k].Im));
+	}
+	if (emax > 1e-5) {
+		printf("FAIL radix2 err=%g\n", emax);
+		fail = 1;
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+static int check_sizes(void)
+{
+	static const int sizes[] = {
+		1, 2, 4, 8, 16, 64, 256, 512, 1024, 4096,	/* radix 2 */
+		3, 5, 6, 7, 12, 15, 30, 49, 686, 1323, 1372,	/* mixed */
+		11, 17, 1363, 1364, 1373,			/* bluestein */
+	};
+	int i, dir, fail = 0;
+	double e;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (dir = FFT_FORWARD; dir <= FFT_INVERSE; dir++) {
+			e = check_size(sizes[i], dir);
+			if (e > 1e-5) {
+				printf("FAIL n=%d dir=%d err=%g\n", sizes[i], dir, e);
+				fail = 1;
+			}
+		}
+		e = check_real(sizes[i]);
+		if (e > 1e-5) {
+			printf("FAIL n=%d real err=%g\n", sizes[i], e);
+			fail = 1;
+		}
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
 }
 
 /*
-   ifft(v,N):
-   [0] If N==1 then return.
-   [1] For k = 0 to N/2-1, let ve[k] = v[2*k]
-   [2] Compute ifft(ve, N/2);
-   [3] For k = 0 to N/2-1, let vo[k] = v[2*k+1]
-   [4] Compute ifft(vo, N/2);
-   [5] For m = 0 to N/2-1, do [6] through [9]
-   [6]   Let w.re = cos(2*PI*m/N)
-   [7]   Let w.im = sin(2*PI*m/N)
-   [8]   Let v[m] = ve[m] + w*vo[m]
-   [9]   Let v[m+N/2] = ve[m] - w*vo[m]
+ * too large for the direct DFT: a few random tones at bin centres, whose
+ * transform is known exactly, synthesized in double precision
  */
-void _ifft(complex *v, int n, complex *tmp)
-{
-  if(n>1) {			/* otherwise, do nothing and return */
-    int k,m;    complex z, w, *vo, *ve;
-    ve = tmp; vo = tmp+n/2;
-    for(k=0; k<n/2; k++) {
-      ve[k] = v[2*k];
-      vo[k] = v[2*k+1];
-    }
-    _ifft( ve, n/2, v );		/* FFT on even-indexed elements of v[] */
-    _ifft( vo, n/2, v );		/* FFT on odd-indexed elements of v[] */
-    for(m=0; m<n/2; m++) {
-      w.Re = cos(2*PI*m/(double)n);
-      w.Im = sin(2*PI*m/(double)n);
-      z.Re = w.Re*vo[m].Re - w.Im*vo[m].Im;	/* Re(w*vo[m]) */
-      z.Im = w.Re*vo[m].Im + w.Im*vo[m].Re;	/* Im(w*vo[m]) */
-      v[  m  ].Re = ve[m].Re + z.Re;
-      v[  m  ].Im = ve[m].Im + z.Im;
-      v[m+n/2].Re = ve[m].Re - z.Re;
-      v[m+n/2].Im = ve[m].Im - z.Im;
-    }
-  }
-}
-
-void ifft(complex *v, int n, complex *tmp)
+static int check_large(int n)
 {
-	int i;
+	complex *v = malloc(sizeof(*v) * n);
+	double a, err = 0.0, ref = 0.0, dr, di;
+	double wr[8], wi[8], pr[8], pi[8], t;
+	int bins[8], k, j, fail;
+	float amp[8];
 
-	_ifft(v, n, tmp);
-	for (i = 0; i < n; i++) {
-		v[i].Re /= n;
-		v[i].Im /= n;
+	assert(v);
+	srand(n);
+	for (j = 0; j < 8; j++) {
+		bins[j] = rand() % n;
+		amp[j] = (float)rand() / RAND_MAX;
+		a = 2 * PI * bins[j] / n;
+		wr[j] = cos(a);
+		wi[j] = sin(a);
+		pr[j] = amp[j];
+		pi[j] = 0.0;
 	}
+	/* phasor recurrence, resynced every 4K samples */
+	for (k = 0; k < n; k++) {
+		v[k].Re = v[k].Im = 0.0f;
+		for (j = 0; j < 8; j++) {
+			if (!(k & 4095)) {
+				a = 2 * PI * (double)((long long)bins[j] * k % n) / n;
+				pr[j] = amp[j] * cos(a);
+				pi[j] = amp[j] * sin(a);
+			}
+			v[k].Re += pr[j];
+			v[k].Im += pi[j];
+			t = pr[j] * wr[j] - pi[j] * wi[j];
+			pi[j] = pr[j] * wi[j] + pi[j] * wr[j];
+			pr[j] = t;
+		}
+	}
+
+	fft_execute(fft_plan_get(n, FFT_FORWARD), v);
+
+	for (k = 0; k < n; k++) {
+		dr = v[k].Re;
+		di = v[k].Im;
+		for (j = 0; j < 8; j++)
+			if (bins[j] == k)
+				dr -= (double)amp[j] * n;
+		err += dr * dr + di * di;
+	}
+	for (j = 0; j < 8; j++)
+		ref += (double)amp[j] * amp[j] * n * n;
+	free(v);
+
+	fail = sqrt(err / ref) > 1e-5;
+	if (fail)
+		printf("FAIL n=%d threads=%d err=%g\n", n, fft_threads(),
+		       sqrt(err / ref));
+	return fail;
 }
 
-int main(void)
+static int check_sizes_large(void)
 {
-	complex v[N], v1[N], scratch[N];
-	int k;
+	int n, t, fail = 0;
+
+	for (t = 1; t <= 3; t += 2) {
+		fft_set_threads(t);
+		for (n = 1 << 16; n <= 1 << 20; n <<= 2)
+			fail |= check_large(n);
+	}
+	fft_set_threads(1);
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+/* vector kernels must match the scalar ones bit for bit */
+static int check_isa(void)
+{
+	static const char *isa[] = { "sse2", "avx2", "avx512", "neon" };
+	const char *best = fft_isa();
+	int i, n, dir, k, fail = 0;
+	complex *ref, *v;
+
+	for (i = 0; i < sizeof(isa) / sizeof(isa[0]); i++) {
+		if (fft_set_isa(isa[i]))
+			continue;
+		for (n = 2; n <= 1 << 14; n <<= 1) {
+			for (dir = FFT_FORWARD; dir <= FFT_INVERSE; dir++) {
+				ref = malloc(sizeof(*ref) * n);
+				v = malloc(sizeof(*v) * n);
+				assert(ref && v);
+				srand(n);
+				for (k = 0; k < n; k++) {
+					ref[k].Re = (float)rand() / RAND_MAX - 0.5f;
+					ref[k].Im = (float)rand() / RAND_MAX - 0.5f;
+				}
+				memcpy(v, ref, sizeof(*v) * n);
+
+				fft_set_isa("scalar");
+				fft_execute(fft_plan_get(n, dir), ref);
+				fft_set_isa(isa[i]);
+				fft_execute(fft_plan_get(n, dir), v);
+
+				if (memcmp(ref, v, sizeof(*v) * n)) {
+					printf("FAIL %s n=%d dir=%d differs from scalar\n",
+					       isa[i], n, dir);
+					fail = 1;
+				}
+				free(ref);
+				free(v);
+			}
+		}
+		printf("%s: %s matches scalar\n", __func__, isa[i]);
+	}
+	fft_set_isa(best);
+	printf("%s: %s (using %s)\n", __func__, fail ? "FAIL" : "ok", best);
+	return fail;
+}
+
+/*
+ * running average and peak hold against the same recurrences in double,
+ * then the text report read back
+ */
+static int check_psd(void)
+{
+	enum { BINS = 1027, FRAMES = 8, RUN = 21 };
+	static float x[RUN][BINS];
+	double avg, sum, peak, w, e = 0.0;
+	float last[BINS], hz, a, b, c, d;
+	int i, k, m, mode, lines, fail = 0;
+	const float decay = 0.5f;
+	struct psd *p;
+	char *buf, *s, *nl;
+	size_t len;
+	FILE *f;
+
+	srand(1);
+	for (k = 0; k < RUN; k++)
+		for (i = 0; i < BINS; i++)
+			x[k][i] = (float)rand() / RAND_MAX;
+
+	for (mode = PSD_EXP; mode <= PSD_BLOCK; mode++) {
+		p = psd_create(BINS, mode, FRAMES, decay);
+		assert(p);
+		for (k = 0; k < RUN; k++) {
+			psd_update(p, x[k]);
+			m = (k + 1) / FRAMES * FRAMES;
+			if (mode == PSD_EXP)
+				m = k + 1 < FRAMES ? k + 1 : FRAMES;
+			if (psd_avg_count(p) != m) {
+				printf("FAIL psd %s %d frames averaged of %d\n",
+				       psd_mode_name(mode),
+				       (int)psd_avg_count(p), k + 1);
+				fail = 1;
+			}
+		}
+		for (i = 0; i < BINS; i++) {
+			avg = sum = peak = 0.0;
+			for (k = 0; k < RUN; k++) {
+				w = 1.0 / (k + 1 < FRAMES ? k + 1 : FRAMES);
+				avg = avg * (1.0 - w) + x[k][i] * w;
+				peak = fmax(x[k][i], peak * decay);
+			}
+			/* block: the last complete run */
+			m = RUN / FRAMES * FRAMES;
+			for (k = m - FRAMES; k < m; k++)
+				sum += x[k][i] / FRAMES;
+			e = fmax(e, fabs((mode == PSD_EXP ? avg : sum) -
+					 psd_avg(p)[i]));
+			e = fmax(e, fabs(peak - psd_peak(p)[i]));
+		}
+		if (psd_count(p) != RUN || e > 1e-5) {
+			printf("FAIL psd %s count=%lu err=%g\n", psd_mode_name(mode),
+			       psd_count(p), e);
+			fail = 1;
+		}
+
+		/* every bin back from its line, within the printed precision */
+		hz = 44100.0f / 2048;
+		for (i = 0; i < BINS; i++)
+			last[i] = -3.0f * i / BINS;
+		f = open_memstream(&buf, &len);
+		assert(f);
+		psd_print(p, f, last, hz, -120.0f, 0.0f);
+		fclose(f);
+		s = buf;
+		if (strncmp(s, "# hz last avg peak\n", 19))
+			fail = 1;
+		lines = 0;
+		for (s = strchr(s, '\n') + 1; *s && *s != '#'; s = nl + 1, lines++) {
+			nl = strchr(s, '\n');
+			if (!nl || sscanf(s, "%f %f %f %f", &a, &b, &c, &d) != 4 ||
+			    lines >= BINS || fabsf(a - lines * hz) > 0.051f ||
+			    fabsf(b - last[lines]) > 0.0051f ||
+			    fabsf(c - psd_avg_db(p)[lines]) > 0.0051f ||
+			    fabsf(d - psd_peak_db(p)[lines]) > 0.0051f) {
+				printf("FAIL psd line %d\n", lines);
+				fail = 1;
+				break;
+			}
+		}
+		if (lines != BINS || strcmp(s, "# end\n")) {
+			printf("FAIL psd report %d lines\n", lines);
+			fail = 1;
+		}
+		free(buf);
+		psd_destroy(p);
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+/*
+ * Frames out of the stft ring against frames cut straight from the input:
+ * next only ever moves by hop, for a frame or a drop, so frame k starts at
+ * hop * (frames made + dropped).  Pushes larger than the ring make it
+ * drop; a frame kept that was partly overwritten, or a bad mirror of
+ * the ring head, shows up as a mismatch.  The reference repeats the dc
+ * tracking, the Hann window and the power normalization in double.
+ */
+static int check_stft(void)
+{
+	enum { SIZE = 64, HOP = 24, LEN = 200000 };
+	double re, im, a, sum, dc = 0.0, w[SIZE], x[SIZE], pw, wsum = 0.0;
+	unsigned long long head = 0, made = 0, at;
+	unsigned long dropped;
+	const float *p;
+	int16_t *in;
+	int i, k, n, m, fail = 0;
+	double e, emax = 0.0;
+	struct stft *st;
+
+	in = malloc(sizeof(*in) * LEN);
+	st = stft_create(SIZE, HOP, WIN_HANN);
+	assert(in && st);
+	srand(7);
+	for (i = 0; i < LEN; i++)
+		in[i] = rand() % 65536 - 32768;
+	for (i = 0; i < SIZE; i++) {
+		w[i] = 0.5 - 0.5 * cos(2 * M_PI * i / SIZE);
+		wsum += w[i];
+	}
+
+	while (head < LEN) {
+		/* now and then more at once than the ring holds */
+		n = rand() % 16 ? 1 + rand() % 3000 : 20000 + rand() % 3000;
+		n = head + n > LEN ? LEN - head : n;
+		stft_push(st, in + head, n);
+		head += n;
+
+		m = head < SIZE ? head : SIZE;
+		if (memcmp(stft_history(st, m), in + head - m, sizeof(*in) * m)) {
+			printf("FAIL stft history at %llu\n", head);
+			fail = 1;
+		}
+		while (stft_next(st)) {
+			at = HOP * (made + stft_dropped(st));
+			made++;
+			if (at + SIZE > head) {
+				printf("FAIL stft frame at %llu past %llu\n", at, head);
+				fail = 1;
+				break;
+			}
+			sum = 0.0;
+			for (i = 0; i < SIZE; i++) {
+				sum += in[at + i] / 32768.0;
+				x[i] = (in[at + i] / 32768.0 - dc) * w[i];
+			}
+			dc += 0.1 * (sum / SIZE - dc);
+
+			p = stft_power(st);
+			for (k = 0; k <= SIZE / 2; k++) {
+				re = im = 0.0;
+				for (i = 0; i < SIZE; i++) {
+					a = -2 * M_PI * (double)i * k / SIZE;
+					re += x[i] * cos(a);
+					im += x[i] * sin(a);
+				}
+				pw = (re * re + im * im) * 4.0 / (wsum * wsum);
+				if (k == 0 || k == SIZE / 2)
+					pw /= 4;
+				e = fabs(p[k] - pw) / (pw + 1e-3);
+				emax = e > emax ? e : emax;
+			}
+		}
+	}
+	dropped = stft_dropped(st);
+	if (emax > 1e-3 || !dropped || !made) {
+		printf("FAIL stft err=%g made=%llu dropped=%lu\n", emax, made,
+		       dropped);
+		fail = 1;
+	}
+	stft_destroy(st);
+	free(in);
+	printf("%s: %s (%llu frames, %lu dropped)\n", __func__,
+	       fail ? "FAIL" : "ok", made, dropped);
+	return fail;
+}
+
+/* the vector kernels, every length so the scalar tails run too */
+static int check_dsp_window(void)
+{
+	enum { LEN = 1031 };
+	float *dst = fft_alloc(sizeof(*dst) * LEN);
+	float *win = fft_alloc(sizeof(*win) * LEN);
+	int16_t src[LEN + 1];
+	double sum, e, emax = 0.0;
+	int i, n, fail = 0;
+	float got;
+
+	assert(dst && win);
+	srand(8);
+	for (i = 0; i <= LEN; i++)
+		src[i] = rand() % 65536 - 32768;
+	for (i = 0; i < LEN; i++)
+		win[i] = (float)rand() / RAND_MAX;
+
+	for (n = 0; n <= LEN; n++) {
+		/* src need not be aligned */
+		got = dsp_s16_window(dst, src + (n & 1), win, n, 1.0f / 32768,
+				     0.01f);
+		sum = 0.0;
+		for (i = 0; i < n; i++) {
+			sum += src[i + (n & 1)] / 32768.0;
+			e = fabs(dst[i] - (src[i + (n & 1)] / 32768.0 - 0.01) *
+				 win[i]);
+			emax = e > emax ? e : emax;
+		}
+		e = fabs(got - sum) / (n + 1);
+		emax = e > emax ? e : emax;
+	}
+	if (emax > 1e-6) {
+		printf("FAIL dsp_s16_window err=%g\n", emax);
+		fail = 1;
+	}
+	fft_free(dst);
+	fft_free(win);
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+#define RING_ITEMS	200000
+
+static void *ring_producer(void *arg)
+{
+	struct ring *r = arg;
+	unsigned *slot;
+	unsigned i;
+
+	for (i = 0; i < RING_ITEMS; i++) {
+		while (!(slot = ring_write_slot(r)))
+			sched_yield();
+		slot[0] = i;
+		slot[1] = ~i;
+		ring_write_commit(r);
+	}
+	return NULL;
+}
+
+/*
+ * Full and empty on one thread, then a producer thread against this one:
+ * every item arrives once, in order and whole.
+ */
+static int check_ring(void)
+{
+	struct ring *r = ring_create(2 * sizeof(unsigned), 5);
+	unsigned *slot, i;
+	pthread_t tid;
+	int fail = 0;
+
+	assert(r);
+	if (ring_slots(r) != 8 || ring_slot_size(r) < 2 * sizeof(unsigned) ||
+	    ring_read_slot(r)) {
+		printf("FAIL ring empty\n");
+		fail = 1;
+	}
+	for (i = 0; (slot = ring_write_slot(r)); i++) {
+		*slot = i;
+		ring_write_commit(r);
+	}
+	if (i != 8 || ring_count(r) != 8) {
+		printf("FAIL ring took %u\n", i);
+		fail = 1;
+	}
+	for (i = 0; (slot = ring_read_slot(r)); i++) {
+		if (*slot != i)
+			fail = 1;
+		ring_read_commit(r);
+	}
+	if (i != 8 || ring_count(r)) {
+		printf("FAIL ring gave %u\n", i);
+		fail = 1;
+	}
+
+	pthread_create(&tid, NULL, ring_producer, r);
+	for (i = 0; i < RING_ITEMS; i++) {
+		while (!(slot = ring_read_slot(r)))
+			sched_yield();
+		if (slot[0] != i || slot[1] != ~i) {
+			printf("FAIL ring item %u is %u\n", i, slot[0]);
+			fail = 1;
+			break;
+		}
+		ring_read_commit(r);
+	}
+	/* a short read left the producer spinning, drain it */
+	while (i < RING_ITEMS) {
+		if (ring_read_slot(r)) {
+			ring_read_commit(r);
+			i++;
+		} else {
+			sched_yield();
+		}
+	}
+	pthread_join(tid, NULL);
+	ring_destroy(r);
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+static int check_dsp_minmax(void)
+{
+	enum { LEN = 4099 };
+	int16_t src[LEN], mn[LEN], mx[LEN];
+	int i, b, k, block, fail = 0;
+	float sq[LEN];
+	int16_t lo, hi;
+	double acc;
+
+	srand(19);
+	for (i = 0; i < LEN; i++)
+		src[i] = rand() % 65536 - 32768;
+	src[7] = INT16_MIN;
+	src[8] = INT16_MAX;
+
+	for (block = 1; block <= 70; block++) {
+		dsp_s16_minmax(src + 1, LEN - 1, block, mn, mx, sq);
+		for (b = 0; b < (LEN - 1) / block; b++) {
+			lo = INT16_MAX;
+			hi = INT16_MIN;
+			acc = 0.0;
+			for (k = 1 + b * block; k < 1 + (b + 1) * block; k++) {
+				lo = src[k] < lo ? src[k] : lo;
+				hi = src[k] > hi ? src[k] : hi;
+				acc += (double)src[k] * src[k];
+			}
+			if (mn[b] != lo || mx[b] != hi ||
+			    fabs(sq[b] - acc) > 1e-5 * acc) {
+				printf("FAIL dsp_s16_minmax block=%d %d\n", block, b);
+				fail = 1;
+				break;
+			}
+		}
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+/*
+ * The input is a ramp, so a column's min and max are its first and last
+ * sample: the columns have to tile the view exactly, whatever level
+ * answers them and wherever the ring wraps, and the rms has to be that of
+ * the samples they claim.  Views stay inside one rise of the ramp.
+ */
+static int check_wave(void)
+{
+	enum { CAP = 20000, LEN = 600000, COLS = 1500 };
+	struct wave_span out[COLS];
+	unsigned long long head = 0, start, first, last, next, j;
+	int i, n, v, len, avail, cols, c, views = 0, fail = 0;
+	struct wave *w;
+	int16_t *in;
+	double acc;
+
+	in = malloc(sizeof(*in) * LEN);
+	w = wave_create(CAP);
+	assert(in && w);
+	for (i = 0; i < LEN; i++)
+		in[i] = i % 65536 - 32768;
+
+	srand(20);
+	while (head < LEN && !fail) {
+		n = 1 + rand() % 5000;
+		n = head + n > LEN ? LEN - head : n;
+		wave_push(w, in + head, n);
+		head += n;
+
+		for (v = 0; v < 8 && !fail; v++) {
+			avail = head - wave_oldest(w);
+			len = 1 + rand() % avail;
+			start = wave_oldest(w) + rand() % (avail - len + 1);
+			if (start % 65536 + len > 65536)
+				continue;
+			cols = 1 + rand() % (len < COLS ? len : COLS);
+			if (wave_columns(w, start, len, out, cols)) {
+				printf("FAIL wave_columns refused %llu+%d\n", start,
+				       len);
+				fail = 1;
+				break;
+			}
+			views++;
+
+			next = start;
+			for (c = 0; c < cols; c++) {
+				first = start + (out[c].min - in[start]);
+				last = start + (out[c].max - in[start]);
+				acc = 0.0;
+				for (j = first; j <= last; j++)
+					acc += (double)in[j] * in[j];
+				acc = sqrt(acc / (last - first + 1));
+				if (first != next || last < first ||
+				    fabs(out[c].rms - acc) > 1e-3 * acc + 1e-3) {
+					printf("FAIL wave %llu+%d/%d col %d"
+					       " [%llu %llu] at %llu\n", start, len,
+					       cols, c, first, last, next);
+					fail = 1;
+					break;
+				}
+				next = last + 1;
+			}
+			if (!fail && next != start + len) {
+				printf("FAIL wave %llu+%d/%d ends at %llu\n", start, len,
+				       cols, next);
+				fail = 1;
+			}
+		}
+	}
+	wave_destroy(w);
+	free(in);
+	printf("%s: %s (%d views)\n", __func__, fail ? "FAIL" : "ok", views);
+	return fail;
+}
+
+/*
+ * Every band's weights sum to one, so a flat spectrum reads 1 everywhere.
+ * On a ramp mag[k] = k a band reads its mean bin: a constant-Q band too
+ * narrow to hold a bin interpolates, which is exact on a ramp and lands on
+ * its centre; wider ones are symmetric in Hz and stay within a bin of it.
+ */
+static int check_bands(void)
+{
+	enum { SIZE = 4096, RATE = 44100 };
+	const float hz = (float)RATE / SIZE;
+	const float bw = exp2f(1.0f / CQT_PER_OCTAVE) - 1;
+	/* widths in pixels, the cqt wants 216 bands over 40 Hz - 20 kHz */
+	static const int widths[] = { 1, 2, 7, 100, 160, 215, 216, 1000 };
+	static float ones[SIZE / 2 + 1], ramp[SIZE / 2 + 1], out[2048];
+	int scale, i, j, n, narrow = 0, wide = 0, fail = 0;
+	struct bands *b;
+	float c, e;
+
+	for (i = 0; i <= SIZE / 2; i++) {
+		ones[i] = 1.0f;
+		ramp[i] = i;
+	}
+
+	for (scale = SCALE_LOG; scale < SCALE_COUNT; scale++) {
+		for (j = 0; j < sizeof(widths) / sizeof(widths[0]); j++) {
+			b = bands_create(scale, widths[j], SIZE, RATE, 40.0f,
+					 20000.0f);
+			assert(b);
+			n = bands_count(b);
+			if (n < 1 || n > widths[j]) {
+				printf("FAIL bands %s %d bands for %d\n",
+				       scale_name(scale), n, widths[j]);
+				fail = 1;
+			}
+			bands_destroy(b);
+		}
+
+		b = bands_create(scale, 256, SIZE, RATE, 40.0f, 20000.0f);
+		assert(b);
+		n = bands_count(b);
+		assert(n <= 2048);
+		bands_apply(b, ones, out);
+		for (i = 0; i < n; i++) {
+			if (fabsf(out[i] - 1.0f) > 1e-5f) {
+				printf("FAIL bands %s %d sums to %g\n",
+				       scale_name(scale), i, out[i]);
+				fail = 1;
+				break;
+			}
+		}
+		if (scale != SCALE_CQT) {
+			bands_destroy(b);
+			continue;
+		}
+
+		bands_apply(b, ramp, out);
+		for (i = 0; i < n; i++) {
+			c = bands_center(b, i);
+			e = fabsf(out[i] - c / hz);
+			/* no bin strictly inside (c - cq, c + cq) */
+			if (ceilf(c * (1 - bw) / hz) > floorf(c * (1 + bw) / hz)) {
+				narrow++;
+				fail |= e > 1e-3f;
+			} else {
+				wide++;
+				fail |= e > 1.0f;
+			}
+			if (fail) {
+				printf("FAIL bands cqt %d at %g Hz reads bin %g\n",
+				       i, c, out[i]);
+				break;
+			}
+		}
+		bands_destroy(b);
+	}
+	if (!narrow || !wide) {
+		printf("FAIL bands %d narrow %d wide\n", narrow, wide);
+		fail = 1;
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+/* random ranges, short ones and ones long enough for the vector loop */
+static int check_dsp_ranges(void)
+{
+	enum { LEN = 4096, RANGES = 512 };
+	static float x[LEN], out[RANGES];
+	int lo[RANGES], hi[RANGES];
+	int t, i, k, n, fail = 0;
+	float m, top, got;
+
+	srand(23);
+	for (t = 0; t < 200 && !fail; t++) {
+		for (i = 0; i < LEN; i++)
+			x[i] = (float)rand() / RAND_MAX - 0.5f;
+		n = 1 + rand() % RANGES;
+		for (i = 0; i < n; i++) {
+			lo[i] = rand() % (LEN - 100);
+			hi[i] = lo[i] + 1 + rand() % (t % 2 ? 5 : 99);
+		}
+		got = dsp_max_ranges(x, lo, hi, n, out);
+		top = -INFINITY;
+		for (i = 0; i < n; i++) {
+			m = x[lo[i]];
+			for (k = lo[i]; k < hi[i]; k++)
+				m = x[k] > m ? x[k] : m;
+			top = m > top ? m : top;
+			if (out[i] != m) {
+				printf("FAIL dsp_max_ranges [%d %d)\n", lo[i], hi[i]);
+				fail = 1;
+				break;
+			}
+		}
+		if (got != top) {
+			printf("FAIL dsp_max_ranges top %g %g\n", got, top);
+			fail = 1;
+		}
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+/*
+ * The fast log against 10 * log10 in double over the whole float range a
+ * spectrum can reach, for floors down at STFT_DB_MIN and a ceiling: what
+ * the dB path claims is 1e-4 dB.  Odd lengths run the scalar tails.
+ */
+static int check_dsp_db(void)
+{
+	enum { LEN = 4099 };
+	static const float floors[] = { STFT_DB_MIN, STFT_DB_MIN + 0.3f, -120.0f };
+	float *c = fft_alloc(sizeof(*c) * 2 * LEN);
+	float *norm = fft_alloc(sizeof(*norm) * LEN);
+	float *pw = fft_alloc(sizeof(*pw) * LEN);
+	float *db = fft_alloc(sizeof(*db) * LEN);
+	double ref, e, emax = 0.0, p;
+	int f, t, i, n, fail = 0;
+	float lo, hi = 30.0f;
+	uint32_t bits;
+
+	assert(c && norm && pw && db);
+	srand(24);
+	for (f = 0; f < sizeof(floors) / sizeof(floors[0]); f++) {
+		lo = floors[f];
+		for (t = 0; t < 64; t++) {
+			n = LEN - t;
+			for (i = 0; i < n; i++) {
+				/* |re| with every exponent from 2^-120 to 2^20 */
+				bits = (uint32_t)(7 + (i * 140 + t) % 141) << 23 |
+				       (uint32_t)rand() % (1u << 23);
+				memcpy(&c[2 * i], &bits, sizeof(bits));
+				c[2 * i + 1] = c[2 * i] * ((float)rand() / RAND_MAX);
+				norm[i] = 0.25f + (float)rand() / RAND_MAX;
+			}
+			dsp_power_db(c, norm, n, pw, db, lo, hi);
+			for (i = 0; i < n; i++) {
+				p = ((double)c[2 * i] * c[2 * i] +
+				     (double)c[2 * i + 1] * c[2 * i + 1]) * norm[i];
+				ref = fmin(fmax(10 * log10(p), lo), hi);
+				e = fabs(db[i] - ref);
+				emax = e > emax ? e : emax;
+				/* the power itself where float still holds it */
+				if (p > FLT_MIN && fabs(pw[i] - p) > 1e-6 * p) {
+					printf("FAIL dsp_power_db %g for %g\n", pw[i], p);
+					fail = 1;
+				}
+			}
+			/* the dB half alone, in place */
+			memcpy(db, pw, sizeof(*db) * n);
+			dsp_db(db, n, db, lo, hi);
+			for (i = 0; i < n; i++) {
+				ref = fmin(fmax(10 * log10(pw[i]), lo), hi);
+				e = fabs(db[i] - ref);
+				emax = e > emax ? e : emax;
+			}
+		}
+	}
+	if (emax > 1e-4) {
+		printf("FAIL dsp db err=%g dB\n", emax);
+		fail = 1;
+	}
+	fft_free(c);
+	fft_free(norm);
+	fft_free(pw);
+	fft_free(db);
+	printf("%s: %s (%.1e dB)\n", __func__, fail ? "FAIL" : "ok", emax);
+	return fail;
+}
+
+/* a full scale sine centred on a bin reads 0 dB through every window */
+static int check_stft_db(void)
+{
+	enum { SIZE = 1024, BIN = 100 };
+	int16_t x[SIZE];
+	int win, i, fail = 0;
+	struct stft *st;
+	float v;
+
+	for (i = 0; i < SIZE; i++)
+		x[i] = lrint(32767 * sin(2 * M_PI * BIN * i / SIZE));
+	for (win = WIN_RECT; win <= WIN_BLACKMAN; win++) {
+		st = stft_create(SIZE, SIZE, win);
+		assert(st);
+		stft_push(st, x, SIZE);
+		assert(stft_next(st));
+		v = stft_db(st)[BIN];
+		if (fabsf(v) > 0.01f) {
+			printf("FAIL stft %s full scale reads %g dB\n",
+			       stft_window_name(win), v);
+			fail = 1;
+		}
+		stft_destroy(st);
+	}
+	printf("%s: %s\n", __func__, fail ? "FAIL" : "ok");
+	return fail;
+}
+
+static double now_us(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec * 1e6 + tp.tv_nsec / 1e3;
+}
+
+/* microseconds per forward transform, averaged over ~0.2s */
+static double bench_size(int n, int dir)
+{
+	struct fft_plan *p = fft_plan_get(n, dir);
+	complex *v = fft_plan_work(p);
+	double t0, t;
+	int i, iter = 0;
+
+	for (i = 0; i < (dir == FFT_REAL ? n / 2 : n); i++) {
+		v[i].Re = (float)rand() / RAND_MAX - 0.5f;
+		v[i].Im = dir == FFT_REAL ? (float)rand() / RAND_MAX - 0.5f : 0.0f;
+	}
+	fft_execute(p, v);
+
+	t0 = now_us();
+	do {
+		for (i = 0; i < 64; i++)
+			fft_execute(p, v);
+		iter += 64;
+		t = now_us() - t0;
+	} while (t < 200000.0);
+	return t / iter;
+}
+
+static int next_pow2(int n)
+{
+	int m;
+
+	for (m = 1; m < n; m <<= 1)
+		;
+	return m;
+}
+
+/*
+ * each size against the radix 2 transform of the next power of two, the
+ * zero padding alternative
+ */
+static void bench(int argc, char *argv[])
+{
+	static const int sizes[] = { 686, 1323, 1363, 1364, 1372, 1373, 1024, 2048 };
+	double t, t2, tr;
+	int i, n;
+
+	printf("%8s %12s %8s %12s %8s %12s\n", "n", "us", "pow2", "us", "ratio",
+	       "real us");
+	for (i = 0; i < (argc ? argc : sizeof(sizes) / sizeof(sizes[0])); i++) {
+		n = argc ? atoi(argv[i]) : sizes[i];
+		if (n < 1)
+			continue;
+		t = bench_size(n, FFT_FORWARD);
+		t2 = bench_size(next_pow2(n), FFT_FORWARD);
+		tr = bench_size(n, FFT_REAL);
+		printf("%8d %12.2f %8d %12.2f %8.2f %12.2f\n", n, t, next_pow2(n),
+		       t2, t / t2, tr);
+	}
+}
+
+/* throughput of the large transforms against thread count */
+static void bench_threads(int argc, char *argv[])
+{
+	int n, t, max = argc ? atoi(argv[0]) : sysconf(_SC_NPROCESSORS_ONLN);
+	double us, us1;
+
+	printf("%8s %8s %12s %12s %8s\n", "n", "threads", "us", "Mpts/s",
+	       "speedup");
+	for (n = 1 << 16; n <= 1 << 20; n <<= 1) {
+		for (t = 1, us1 = 0.0; t <= max; t <<= 1) {
+			if (fft_set_threads(t))
+				break;
+			us = bench_size(n, FFT_FORWARD);
+			if (t == 1)
+				us1 = us;
+			printf("%8d %8d %12.1f %12.1f %8.2f\n", n, t, us, n / us,
+			       us1 / us);
+		}
+	}
+	fft_set_threads(1);
+}
+
+int main(int argc, char *argv[])
+{
+	complex v[N], v1[N];
+	int k, fail = 0;
+
+	if (getenv("FFT_ISA") && fft_set_isa(getenv("FFT_ISA"))) {
+		printf("FFT_ISA=%s not supported\n", getenv("FFT_ISA"));
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		bench(argc - 2, argv + 2);
+		return EXIT_SUCCESS;
+	}
+	if (argc > 1 && !strcmp(argv[1], "threads")) {
+		bench_threads(argc - 2, argv + 2);
+		return EXIT_SUCCESS;
+	}
 
 	/* Fill v[] with a function of known FFT: */
 	for (k = 0; k < N; k++) {
@@ -129,20 +1107,38 @@ int main(void)
 
 	/* FFT, iFFT of v[]: */
 	print_vector("Orig", v, N);
-	fft( v, N, scratch );
+	fft(v, N);
 	print_vector(" FFT", v, N);
-	ifft( v, N, scratch );
+	ifft(v, N);
 	print_vector("iFFT", v, N);
 	putchar('\n');
 
 #if 1
 	/* FFT, iFFT of v1[]: */
 	print_vector("Orig", v1, N);
-	fft( v1, N, scratch );
+	fft(v1, N);
 	print_vector(" FFT", v1, N);
-	ifft( v1, N, scratch );
+	ifft(v1, N);
 	print_vector("iFFT", v1, N);
-
+	putchar('\n');
 #endif
-	return EXIT_SUCCESS;
+
+
+	fail |= check_radix2();
+	fail |= check_sizes();
+	fail |= check_isa();
+	fail |= check_sizes_large();
+	fail |= check_dsp_window();
+	fail |= check_ring();
+	fail |= check_stft();
+	fail |= check_dsp_minmax();
+	fail |= check_wave();
+	fail |= check_bands();
+	fail |= check_dsp_ranges();
+	fail |= check_dsp_db();
+	fail |= check_stft_db();
+	fail |= check_psd();
+
+	fft_plan_flush();
+	return fail ? EXIT_FAILURE : EXIT_SUCCESS;
 }
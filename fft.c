@@ -0,0 +1,852 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+#include "fft-simd.h"
+#include "pool.h"
+
+#define MIN(x, y)	(((x) < (y)) ? (x) : (y))
+
+#define CACHE_LINE	64
+#define MAX_FACTORS	32
+
+#define SIXSTEP_MIN	(1 << 16)	/* smallest power of two done in six steps */
+#define SIXSTEP_SERIAL	(1 << 20)	/* ... when there is only one thread */
+#define SIXSTEP_BLOCK	16		/* columns per gather, two cache lines */
+#define SIXSTEP_PAD	16		/* floats, keeps columns off one cache set */
+
+enum {
+	FFT_RADIX2,		/* power of two, iterative in place */
+	FFT_MIXED,		/* n = 2^a 3^b 5^c 7^d, recursive out of place */
+	FFT_BLUESTEIN,		/* anything else, via a power of two convolution */
+	FFT_R2C,		/* real input, n/2 point complex transform */
+	FFT_R2C_ODD,		/* real input, odd n, full complex transform */
+	FFT_SIXSTEP,		/* large power of two, n1 x n2 column passes */
+};
+
+struct fft_plan {
+	int n;
+	int dir;
+	int kind;
+	complex *tw;		/* e^(-+2*pi*i*m/n), m < n (mixed) */
+	int *rev;		/* bit-reversal permutation */
+	float *twr;		/* radix 2, stage h at [h, 2h): e^(-+pi*i*m/h) */
+	float *twi;
+	float *re;		/* radix 2, split re/im workspace */
+	float *im;
+	complex *work;		/* n points, for the caller */
+	complex *tmp;		/* n points (m for bluestein), internal */
+
+	/* mixed radix: radix, remaining length pairs, 0 terminated */
+	int factors[2 * MAX_FACTORS + 2];
+
+	/* bluestein */
+	complex *chirp;		/* e^(-+i*pi*k^2/n), k < n */
+	complex *bfft;		/* transform of the conjugate chirp, m points */
+	struct fft_plan *fwd;	/* size m sub-plans; n/2 or n for real input */
+	struct fft_plan *inv;
+
+	/* six-step: tw holds e^(-+2*pi*i*j/n), j < n1, then j * n1, j < n2 */
+	int n1;
+	int n2;
+	int lg1;		/* log2(n1) */
+	struct fft_plan *sub1;	/* radix 2, length n1 and n2 */
+	struct fft_plan *sub2;
+	struct fft_plan *serial;	/* plain radix 2, below SIXSTEP_SERIAL */
+	float *scratch;		/* per pool part, SIXSTEP_BLOCK columns */
+	int parts;
+
+	struct fft_plan *next;
+};
+
+static struct fft_plan *plan_cache;
+static struct pool *fft_pool;
+
+void *fft_alloc(size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, CACHE_LINE, size ? size : CACHE_LINE))
+		return NULL;
+	return p;
+}
+
+void fft_free(void *ptr)
+{
+	free(ptr);
+}
+
+static int is_pow2(int n)
+{
+	return n > 0 && !(n & (n - 1));
+}
+
+/* split n into radix 4, 2, 3, 5, 7 stages; fails if another prime remains */
+static int factorize(int n, int *f)
+{
+	static const int radix[] = { 4, 2, 3, 5, 7 };
+	int i, cnt = 0;
+
+	for (i = 0; i < sizeof(radix) / sizeof(radix[0]); i++) {
+		while (n % radix[i] == 0 && cnt < MAX_FACTORS) {
+			n /= radix[i];
+			*f++ = radix[i];
+			*f++ = n;
+			cnt++;
+		}
+	}
+	*f++ = 0;
+	*f = 0;
+	return n == 1 ? 0 : -1;
+}
+
+static void twiddles(complex *tw, int cnt, int n, double sign)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		tw[i].Re = cos(2 * M_PI * i / (double)n);
+		tw[i].Im = sign * sin(2 * M_PI * i / (double)n);
+	}
+}
+
+static int plan_radix2(struct fft_plan *p, double sign)
+{
+	int n = p->n, i, j, k, h;
+
+	p->rev = fft_alloc(sizeof(*p->rev) * n);
+	p->twr = fft_alloc(sizeof(*p->twr) * n);
+	p->twi = fft_alloc(sizeof(*p->twi) * n);
+	p->re = fft_alloc(sizeof(*p->re) * n);
+	p->im = fft_alloc(sizeof(*p->im) * n);
+	if (!p->rev || !p->twr || !p->twi || !p->re || !p->im)
+		return -1;
+
+	for (h = 1; h < n; h <<= 1) {
+		for (i = 0; i < h; i++) {
+			p->twr[h + i] = cos(M_PI * i / (double)h);
+			p->twi[h + i] = sign * sin(M_PI * i / (double)h);
+		}
+	}
+
+	for (i = 0, j = 0; i < n; i++) {
+		p->rev[i] = j;
+		for (k = n >> 1; k && (j & k); k >>= 1)
+			j ^= k;
+		j |= k;
+	}
+	return 0;
+}
+
+static int plan_mixed(struct fft_plan *p, double sign)
+{
+	p->tw = fft_alloc(sizeof(*p->tw) * p->n);
+	p->tmp = fft_alloc(sizeof(*p->tmp) * p->n);
+	if (!p->tw || !p->tmp)
+		return -1;
+
+	twiddles(p->tw, p->n, p->n, sign);
+	return 0;
+}
+
+static int plan_bluestein(struct fft_plan *p, double sign)
+{
+	int n = p->n, m, k;
+	double a;
+
+	for (m = 1; m < 2 * n - 1; m <<= 1)
+		;
+
+	p->fwd = fft_plan_create(m, FFT_FORWARD);
+	p->inv = fft_plan_create(m, FFT_INVERSE);
+	p->chirp = fft_alloc(sizeof(*p->chirp) * n);
+	p->bfft = fft_alloc(sizeof(*p->bfft) * m);
+	p->tmp = fft_alloc(sizeof(*p->tmp) * m);
+	if (!p->fwd || !p->inv || !p->chirp || !p->bfft || !p->tmp)
+		return -1;
+
+	/* k^2 mod 2n keeps the chirp angle exact for large k */
+	for (k = 0; k < n; k++) {
+		a = M_PI * (double)((long long)k * k % (2LL * n)) / n;
+		p->chirp[k].Re = cos(a);
+		p->chirp[k].Im = sign * sin(a);
+	}
+
+	memset(p->bfft, 0, sizeof(*p->bfft) * m);
+	for (k = 0; k < n; k++) {
+		p->bfft[k].Re = p->chirp[k].Re;
+		p->bfft[k].Im = -p->chirp[k].Im;
+		if (k)
+			p->bfft[m - k] = p->bfft[k];
+	}
+	fft_execute(p->fwd, p->bfft);
+	return 0;
+}
+
+/*
+ * n real samples viewed as n/2 complex points z[k] = x[2k] + i x[2k+1];
+ * the half size transform is split into its even/odd sample spectra and
+ * recombined with tw[k] = e^(-2*pi*i*k/n)
+ */
+static int plan_r2c(struct fft_plan *p)
+{
+	int n = p->n;
+
+	if (n & 1) {
+		p->kind = FFT_R2C_ODD;
+		p->fwd = fft_plan_create(n, FFT_FORWARD);
+		p->tmp = fft_alloc(sizeof(*p->tmp) * n);
+		return p->fwd && p->tmp ? 0 : -1;
+	}
+
+	p->kind = FFT_R2C;
+	p->fwd = fft_plan_create(n / 2, FFT_FORWARD);
+	p->tw = fft_alloc(sizeof(*p->tw) * (n / 4 + 1));
+	if (!p->fwd || !p->tw)
+		return -1;
+
+	twiddles(p->tw, n / 4 + 1, n, -1.0);
+	return 0;
+}
+
+/* on failure the old scratch, if any, stays */
+static int sixstep_scratch(struct fft_plan *p, int parts)
+{
+	float *s;
+
+	s = fft_alloc(sizeof(*s) * 2 * SIXSTEP_BLOCK * (p->n2 + SIXSTEP_PAD) *
+		      parts);
+	if (!s)
+		return -1;
+	fft_free(p->scratch);
+	p->scratch = s;
+	p->parts = parts;
+	return 0;
+}
+
+/*
+ * n = n1 * n2 viewed as an n1 x n2 matrix: n2 column transforms of length
+ * n1, a twiddle multiply and n1 column transforms of length n2, each done
+ * SIXSTEP_BLOCK columns at a time so every cache line fetched is used and
+ * split across the pool; the transposes happen in the gather/scatter.  On
+ * a single thread the in-cache radix 2 passes still win for the smaller
+ * sizes, so those plans keep one of those too.
+ */
+static struct fft_plan *plan_create(int n, int dir, int sixstep);
+
+static int plan_sixstep(struct fft_plan *p, double sign)
+{
+	int n = p->n, lg, i;
+	double a;
+
+	for (lg = 0; (1 << lg) < n; lg++)
+		;
+	p->lg1 = lg / 2;
+	p->n1 = 1 << p->lg1;
+	p->n2 = n / p->n1;
+
+	if (n < SIXSTEP_SERIAL) {
+		p->serial = plan_create(n, p->dir, 0);
+		if (!p->serial)
+			return -1;
+	}
+
+	p->sub1 = fft_plan_create(p->n1, p->dir);
+	p->sub2 = fft_plan_create(p->n2, p->dir);
+	p->tw = fft_alloc(sizeof(*p->tw) * (p->n1 + p->n2));
+	p->tmp = fft_alloc(sizeof(*p->tmp) * n);
+	if (!p->sub1 || !p->sub2 || !p->tw || !p->tmp)
+		return -1;
+
+	for (i = 0; i < p->n1 + p->n2; i++) {
+		a = 2 * M_PI * (i < p->n1 ? i : (double)(i - p->n1) * p->n1) / n;
+		p->tw[i].Re = cos(a);
+		p->tw[i].Im = sign * sin(a);
+	}
+	return sixstep_scratch(p, pool_threads(fft_pool));
+}
+
+static struct fft_plan *plan_create(int n, int dir, int sixstep)
+{
+	double sign = dir == FFT_INVERSE ? 1.0 : -1.0;
+	struct fft_plan *p;
+	int err;
+
+	if (n < 1) {
+		fprintf(stderr, "%s: unsupported size %d\n", __func__, n);
+		return NULL;
+	}
+	fft_simd_init();
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	p->n = n;
+	p->dir = dir;
+
+	p->work = fft_alloc(sizeof(*p->work) * (dir == FFT_REAL ? n / 2 + 1 : n));
+	if (!p->work) {
+		fft_plan_destroy(p);
+		return NULL;
+	}
+
+	if (dir == FFT_REAL) {
+		err = plan_r2c(p);
+	} else if (is_pow2(n) && n >= SIXSTEP_MIN && sixstep) {
+		p->kind = FFT_SIXSTEP;
+		err = plan_sixstep(p, sign);
+	} else if (is_pow2(n)) {
+		p->kind = FFT_RADIX2;
+		err = plan_radix2(p, sign);
+	} else if (!factorize(n, p->factors)) {
+		p->kind = FFT_MIXED;
+		err = plan_mixed(p, sign);
+	} else {
+		p->kind = FFT_BLUESTEIN;
+		err = plan_bluestein(p, sign);
+	}
+	if (err) {
+		fft_plan_destroy(p);
+		return NULL;
+	}
+	return p;
+}
+
+struct fft_plan *fft_plan_create(int n, int dir)
+{
+	return plan_create(n, dir, 1);
+}
+
+void fft_plan_destroy(struct fft_plan *p)
+{
+	if (!p)
+		return;
+	fft_free(p->tw);
+	fft_free(p->rev);
+	fft_free(p->twr);
+	fft_free(p->twi);
+	fft_free(p->re);
+	fft_free(p->im);
+	fft_free(p->work);
+	fft_free(p->tmp);
+	fft_free(p->chirp);
+	fft_free(p->bfft);
+	fft_plan_destroy(p->fwd);
+	fft_plan_destroy(p->inv);
+	fft_plan_destroy(p->sub1);
+	fft_plan_destroy(p->sub2);
+	fft_plan_destroy(p->serial);
+	fft_free(p->scratch);
+	free(p);
+}
+
+struct fft_plan *fft_plan_get(int n, int dir)
+{
+	struct fft_plan *p;
+
+	for (p = plan_cache; p; p = p->next)
+		if (p->n == n && p->dir == dir)
+			return p;
+
+	p = fft_plan_create(n, dir);
+	if (!p)
+		return NULL;
+	p->next = plan_cache;
+	plan_cache = p;
+	return p;
+}
+
+void fft_plan_flush(void)
+{
+	struct fft_plan *p;
+
+	while ((p = plan_cache)) {
+		plan_cache = p->next;
+		fft_plan_destroy(p);
+	}
+}
+
+int fft_set_threads(int threads)
+{
+	struct pool *p;
+
+	if (threads == pool_threads(fft_pool))
+		return 0;
+
+	p = threads > 1 ? pool_create(threads) : NULL;
+	if (threads > 1 && !p)
+		return -1;
+	pool_destroy(fft_pool);
+	fft_pool = p;
+	return 0;
+}
+
+int fft_threads(void)
+{
+	return pool_threads(fft_pool);
+}
+
+int fft_plan_size(struct fft_plan *p)
+{
+	return p->n;
+}
+
+complex *fft_plan_work(struct fft_plan *p)
+{
+	return p->work;
+}
+
+/*
+ * split arrays in bit-reversed order: radix-4 passes (two stages each) and
+ * a last radix-2 pass when log2(n) is odd; passes too short for the
+ * selected vector width drop to a narrower instruction set
+ */
+static void radix2_passes(struct fft_plan *p, float *re, float *im)
+{
+	const struct fft_kernels *k;
+	int n = p->n, h;
+
+	for (h = 1; 4 * h <= n; h *= 4) {
+		k = fft_kern_for(h);
+		k->r4(re, im, n, h, p->twr + h, p->twi + h,
+		      p->twr + 2 * h, p->twi + 2 * h, p->dir == FFT_INVERSE);
+	}
+	if (h < n) {
+		k = fft_kern_for(h);
+		k->r2(re, im, n, h, p->twr + h, p->twi + h);
+	}
+}
+
+static void fft_radix2(struct fft_plan *p, complex *v)
+{
+	float *re = p->re, *im = p->im;
+	int n = p->n, i;
+
+	for (i = 0; i < n; i++) {
+		re[i] = v[p->rev[i]].Re;
+		im[i] = v[p->rev[i]].Im;
+	}
+
+	radix2_passes(p, re, im);
+
+	for (i = 0; i < n; i++) {
+		v[i].Re = re[i];
+		v[i].Im = im[i];
+	}
+}
+
+/*
+ * mixed radix butterflies, out[k * m + j] for j < m holds the k-th
+ * sub-transform; fstride steps through the full length twiddle table
+ */
+static void bf2(const struct fft_plan *p, complex *out, int fstride, int m)
+{
+	const complex *tw = p->tw;
+	complex *o1 = out + m, t;
+	int j;
+
+	for (j = 0; j < m; j++) {
+		t.Re = o1[j].Re * tw->Re - o1[j].Im * tw->Im;
+		t.Im = o1[j].Re * tw->Im + o1[j].Im * tw->Re;
+		tw += fstride;
+		o1[j].Re = out[j].Re - t.Re;
+		o1[j].Im = out[j].Im - t.Im;
+		out[j].Re += t.Re;
+		out[j].Im += t.Im;
+	}
+}
+
+#define CMUL(r, a, b)	do {					\
+	(r).Re = (a).Re * (b).Re - (a).Im * (b).Im;		\
+	(r).Im = (a).Re * (b).Im + (a).Im * (b).Re;		\
+} while (0)
+
+static void bf3(const struct fft_plan *p, complex *out, int fstride, int m)
+{
+	float s = p->tw[fstride * m].Im;	/* -+sin(2pi/3) */
+	complex t0, t1, t2, t3;
+	int j;
+
+	for (j = 0; j < m; j++) {
+		CMUL(t1, out[j + m], p->tw[j * fstride]);
+		CMUL(t2, out[j + 2 * m], p->tw[2 * j * fstride]);
+
+		t3.Re = t1.Re + t2.Re;
+		t3.Im = t1.Im + t2.Im;
+		t0.Re = t1.Re - t2.Re;
+		t0.Im = t1.Im - t2.Im;
+
+		out[j + m].Re = out[j].Re - 0.5f * t3.Re;
+		out[j + m].Im = out[j].Im - 0.5f * t3.Im;
+		t0.Re *= s;
+		t0.Im *= s;
+		out[j].Re += t3.Re;
+		out[j].Im += t3.Im;
+
+		out[j + 2 * m].Re = out[j + m].Re + t0.Im;
+		out[j + 2 * m].Im = out[j + m].Im - t0.Re;
+		out[j + m].Re -= t0.Im;
+		out[j + m].Im += t0.Re;
+	}
+}
+
+static void bf4(const struct fft_plan *p, complex *out, int fstride, int m)
+{
+	complex t0, t1, t2, t3, t4, t5;
+	int j;
+
+	for (j = 0; j < m; j++) {
+		CMUL(t0, out[j + m], p->tw[j * fstride]);
+		CMUL(t1, out[j + 2 * m], p->tw[2 * j * fstride]);
+		CMUL(t2, out[j + 3 * m], p->tw[3 * j * fstride]);
+
+		t5.Re = out[j].Re - t1.Re;
+		t5.Im = out[j].Im - t1.Im;
+		out[j].Re += t1.Re;
+		out[j].Im += t1.Im;
+		t3.Re = t0.Re + t2.Re;
+		t3.Im = t0.Im + t2.Im;
+		t4.Re = t0.Re - t2.Re;
+		t4.Im = t0.Im - t2.Im;
+
+		out[j + 2 * m].Re = out[j].Re - t3.Re;
+		out[j + 2 * m].Im = out[j].Im - t3.Im;
+		out[j].Re += t3.Re;
+		out[j].Im += t3.Im;
+		if (p->dir == FFT_INVERSE) {
+			out[j + m].Re = t5.Re - t4.Im;
+			out[j + m].Im = t5.Im + t4.Re;
+			out[j + 3 * m].Re = t5.Re + t4.Im;
+			out[j + 3 * m].Im = t5.Im - t4.Re;
+		} else {
+			out[j + m].Re = t5.Re + t4.Im;
+			out[j + m].Im = t5.Im - t4.Re;
+			out[j + 3 * m].Re = t5.Re - t4.Im;
+			out[j + 3 * m].Im = t5.Im + t4.Re;
+		}
+	}
+}
+
+static void bf5(const struct fft_plan *p, complex *out, int fstride, int m)
+{
+	complex ya = p->tw[fstride * m], yb = p->tw[2 * fstride * m];
+	complex s0, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10, s11, s12;
+	complex *o0 = out, *o1 = out + m, *o2 = out + 2 * m;
+	complex *o3 = out + 3 * m, *o4 = out + 4 * m;
+	int j;
+
+	for (j = 0; j < m; j++) {
+		s0 = o0[j];
+		CMUL(s1, o1[j], p->tw[j * fstride]);
+		CMUL(s2, o2[j], p->tw[2 * j * fstride]);
+		CMUL(s3, o3[j], p->tw[3 * j * fstride]);
+		CMUL(s4, o4[j], p->tw[4 * j * fstride]);
+
+		s7.Re = s1.Re + s4.Re;	s7.Im = s1.Im + s4.Im;
+		s10.Re = s1.Re - s4.Re;	s10.Im = s1.Im - s4.Im;
+		s8.Re = s2.Re + s3.Re;	s8.Im = s2.Im + s3.Im;
+		s9.Re = s2.Re - s3.Re;	s9.Im = s2.Im - s3.Im;
+
+		o0[j].Re = s0.Re + s7.Re + s8.Re;
+		o0[j].Im = s0.Im + s7.Im + s8.Im;
+
+		s5.Re = s0.Re + s7.Re * ya.Re + s8.Re * yb.Re;
+		s5.Im = s0.Im + s7.Im * ya.Re + s8.Im * yb.Re;
+		s6.Re =  s10.Im * ya.Im + s9.Im * yb.Im;
+		s6.Im = -s10.Re * ya.Im - s9.Re * yb.Im;
+		o1[j].Re = s5.Re - s6.Re;
+		o1[j].Im = s5.Im - s6.Im;
+		o4[j].Re = s5.Re + s6.Re;
+		o4[j].Im = s5.Im + s6.Im;
+
+		s11.Re = s0.Re + s7.Re * yb.Re + s8.Re * ya.Re;
+		s11.Im = s0.Im + s7.Im * yb.Re + s8.Im * ya.Re;
+		s12.Re = -s10.Im * yb.Im + s9.Im * ya.Im;
+		s12.Im =  s10.Re * yb.Im - s9.Re * ya.Im;
+		o2[j].Re = s11.Re + s12.Re;
+		o2[j].Im = s11.Im + s12.Im;
+		o3[j].Re = s11.Re - s12.Re;
+		o3[j].Im = s11.Im - s12.Im;
+	}
+}
+
+/* any radix, O(radix^2) per point; only used for 7 */
+static void bfgeneric(const struct fft_plan *p, complex *out, int fstride,
+		      int m, int radix)
+{
+	complex s[7], t, acc;
+	int j, q1, q, k, tw;
+
+	for (j = 0; j < m; j++) {
+		for (q1 = 0; q1 < radix; q1++)
+			s[q1] = out[j + q1 * m];
+
+		for (q1 = 0, k = j; q1 < radix; q1++, k += m) {
+			acc = s[0];
+			for (q = 1, tw = 0; q < radix; q++) {
+				tw += fstride * k;
+				if (tw >= p->n)
+					tw -= p->n;
+				CMUL(t, s[q], p->tw[tw]);
+				acc.Re += t.Re;
+				acc.Im += t.Im;
+			}
+			out[k] = acc;
+		}
+	}
+}
+
+static void mixed_work(const struct fft_plan *p, complex *out,
+		       const complex *in, int fstride, const int *f)
+{
+	int radix = *f++, m = *f++, k;
+	complex *o = out;
+
+	if (m == 1) {
+		for (k = 0; k < radix; k++, in += fstride)
+			*o++ = *in;
+	} else {
+		for (k = 0; k < radix; k++, in += fstride, o += m)
+			mixed_work(p, o, in, fstride * radix, f);
+	}
+
+	switch (radix) {
+	case 2: bf2(p, out, fstride, m); break;
+	case 3: bf3(p, out, fstride, m); break;
+	case 4: bf4(p, out, fstride, m); break;
+	case 5: bf5(p, out, fstride, m); break;
+	default: bfgeneric(p, out, fstride, m, radix); break;
+	}
+}
+
+static void fft_mixed(struct fft_plan *p, complex *v)
+{
+	memcpy(p->tmp, v, sizeof(*v) * p->n);
+	mixed_work(p, v, p->tmp, 1, p->factors);
+}
+
+static void fft_bluestein(struct fft_plan *p, complex *v)
+{
+	int n = p->n, m = fft_plan_size(p->fwd), k;
+	complex *a = p->tmp, t;
+
+	for (k = 0; k < n; k++)
+		CMUL(a[k], v[k], p->chirp[k]);
+	memset(&a[n], 0, sizeof(*a) * (m - n));
+
+	fft_execute(p->fwd, a);
+	for (k = 0; k < m; k++) {
+		CMUL(t, a[k], p->bfft[k]);
+		a[k] = t;
+	}
+	fft_execute(p->inv, a);
+
+	for (k = 0; k < n; k++)
+		CMUL(v[k], a[k], p->chirp[k]);
+}
+
+struct sixstep_job {
+	struct fft_plan *p;
+	complex *v;
+	int pass;
+};
+
+/*
+ * pass 0: columns c of v (n1 x n2) -> rows c of tmp (n2 x n1), twiddled
+ * pass 1: columns c of tmp (n2 x n1) -> columns c of v, same layout
+ */
+static void bitrev_split(struct fft_plan *s, float *re, float *im)
+{
+	int r, k;
+	float t;
+
+	for (r = 0; r < s->n; r++) {
+		k = s->rev[r];
+		if (r < k) {
+			t = re[r];
+			re[r] = re[k];
+			re[k] = t;
+			t = im[r];
+			im[r] = im[k];
+			im[k] = t;
+		}
+	}
+}
+
+static void sixstep_cols(struct fft_plan *p, complex *v, int pass, int c0,
+			 int c1, float *re, float *im)
+{
+	struct fft_plan *s = pass ? p->sub2 : p->sub1;
+	const complex *src = pass ? p->tmp : v;
+	int len = s->n, stride = p->n / len, mask = p->n1 - 1;
+	int pitch = len + SIXSTEP_PAD;
+	int c, b, j, r, k, m;
+	const complex *x;
+	complex w, *y;
+
+	for (c = c0; c < c1; c += SIXSTEP_BLOCK) {
+		b = MIN(SIXSTEP_BLOCK, c1 - c);
+
+		for (r = 0; r < len; r++) {
+			x = &src[r * stride + c];
+			for (j = 0, k = r; j < b; j++, k += pitch) {
+				re[k] = x[j].Re;
+				im[k] = x[j].Im;
+			}
+		}
+
+		for (j = 0; j < b; j++) {
+			bitrev_split(s, re + j * pitch, im + j * pitch);
+			radix2_passes(s, re + j * pitch, im + j * pitch);
+		}
+
+		if (pass) {
+			for (r = 0; r < len; r++) {
+				y = &v[r * stride + c];
+				for (j = 0, k = r; j < b; j++, k += pitch) {
+					y[j].Re = re[k];
+					y[j].Im = im[k];
+				}
+			}
+			continue;
+		}
+
+		for (j = 0; j < b; j++) {
+			y = &p->tmp[(c + j) * len];
+			for (r = 0, k = j * pitch; r < len; r++, k++) {
+				m = (c + j) * r;
+				CMUL(w, p->tw[m & mask], p->tw[p->n1 + (m >> p->lg1)]);
+				y[r].Re = re[k] * w.Re - im[k] * w.Im;
+				y[r].Im = re[k] * w.Im + im[k] * w.Re;
+			}
+		}
+	}
+}
+
+static void sixstep_part(void *arg, int part, int parts)
+{
+	struct sixstep_job *job = arg;
+	struct fft_plan *p = job->p;
+	int cols = job->pass ? p->n1 : p->n2;
+	int per = (cols / SIXSTEP_BLOCK + parts - 1) / parts * SIXSTEP_BLOCK;
+	float *re = p->scratch + 2 * SIXSTEP_BLOCK * (p->n2 + SIXSTEP_PAD) * part;
+	float *im = re + SIXSTEP_BLOCK * (p->n2 + SIXSTEP_PAD);
+
+	sixstep_cols(p, job->v, job->pass, MIN(cols, part * per),
+		     MIN(cols, (part + 1) * per), re, im);
+}
+
+static void fft_sixstep(struct fft_plan *p, complex *v)
+{
+	struct sixstep_job job = { .p = p, .v = v };
+
+	if (p->serial && pool_threads(fft_pool) == 1) {
+		fft_radix2(p->serial, v);
+		return;
+	}
+
+	/*
+	 * only grows when the pool does, not on the hot path; when it can't,
+	 * the transform still happens, on this thread with the old scratch
+	 */
+	if (p->parts < pool_threads(fft_pool) &&
+	    sixstep_scratch(p, pool_threads(fft_pool))) {
+		fprintf(stderr, "%s: no scratch for %d threads\n", __func__,
+			pool_threads(fft_pool));
+		if (p->serial) {
+			fft_radix2(p->serial, v);
+			return;
+		}
+		sixstep_part(&job, 0, 1);
+		job.pass = 1;
+		sixstep_part(&job, 0, 1);
+		return;
+	}
+
+	pool_run(fft_pool, sixstep_part, &job);
+	job.pass = 1;
+	pool_run(fft_pool, sixstep_part, &job);
+}
+
+static void fft_r2c(struct fft_plan *p, complex *v)
+{
+	int h = p->n / 2, k;
+	complex a, b, fe, fo, t;
+
+	fft_execute(p->fwd, v);
+
+	a = v[0];
+	v[0].Re = a.Re + a.Im;
+	v[0].Im = 0.0f;
+	v[h].Re = a.Re - a.Im;
+	v[h].Im = 0.0f;
+
+	for (k = 1; k <= h / 2; k++) {
+		a = v[k];
+		b = v[h - k];
+
+		fe.Re = 0.5f * (a.Re + b.Re);
+		fe.Im = 0.5f * (a.Im - b.Im);
+		fo.Re = 0.5f * (a.Im + b.Im);
+		fo.Im = 0.5f * (b.Re - a.Re);
+		CMUL(t, fo, p->tw[k]);
+
+		v[k].Re = fe.Re + t.Re;
+		v[k].Im = fe.Im + t.Im;
+		v[h - k].Re = fe.Re - t.Re;
+		v[h - k].Im = t.Im - fe.Im;
+	}
+}
+
+static void fft_r2c_odd(struct fft_plan *p, complex *v)
+{
+	const float *x = (const float *)v;
+	int n = p->n, k;
+
+	for (k = 0; k < n; k++) {
+		p->tmp[k].Re = x[k];
+		p->tmp[k].Im = 0.0f;
+	}
+	fft_execute(p->fwd, p->tmp);
+	memcpy(v, p->tmp, sizeof(*v) * (n / 2 + 1));
+}
+
+void fft_execute(struct fft_plan *p, complex *v)
+{
+	float s;
+	int i;
+
+	switch (p->kind) {
+	case FFT_RADIX2:
+		fft_radix2(p, v);
+		break;
+	case FFT_MIXED:
+		fft_mixed(p, v);
+		break;
+	case FFT_BLUESTEIN:
+		fft_bluestein(p, v);
+		break;
+	case FFT_R2C:
+		fft_r2c(p, v);
+		break;
+	case FFT_R2C_ODD:
+		fft_r2c_odd(p, v);
+		break;
+	case FFT_SIXSTEP:
+		fft_sixstep(p, v);
+		break;
+	}
+
+	if (p->dir != FFT_INVERSE)
+		return;
+
+	s = 1.0f / p->n;
+	for (i = 0; i < p->n; i++) {
+		v[i].Re *= s;
+		v[i].Im *= s;
+	}
+}
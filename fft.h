@@ -0,0 +1,59 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <stddef.h>
+
+typedef struct {
+	float Re, Im;
+} complex;
+
+#define FFT_FORWARD	0
+#define FFT_INVERSE	1
+#define FFT_REAL	2	/* forward, real input */
+
+struct fft_plan;
+
+/*
+ * A plan owns everything a transform of one size/direction needs: twiddles,
+ * the bit-reversal permutation and an n-point cache-line aligned work
+ * buffer.  fft_execute() never allocates.  The inverse transform is scaled
+ * by 1/n.
+ *
+ * FFT_REAL plans take n packed floats and return the n/2 + 1 non-negative
+ * frequency bins in the same buffer; their work buffer is n/2 + 1 points,
+ * which always has room for the n input floats.
+ */
+struct fft_plan *fft_plan_create(int n, int dir);
+void fft_plan_destroy(struct fft_plan *p);
+
+/* cached plans, created on first request and kept until fft_plan_flush() */
+struct fft_plan *fft_plan_get(int n, int dir);
+void fft_plan_flush(void);
+
+int fft_plan_size(struct fft_plan *p);
+complex *fft_plan_work(struct fft_plan *p);
+
+/* in place, v may be the plan's work buffer */
+void fft_execute(struct fft_plan *p, complex *v);
+
+/*
+ * power of two passes use the widest of sse2/avx2/avx512 (or neon) the cpu
+ * supports; fft_set_isa() forces one, "scalar" included
+ */
+const char *fft_isa(void);
+int fft_set_isa(const char *name);
+
+/*
+ * powers of two from 64K points up are done as cache-blocked column passes
+ * (six-step), split across this many threads, the caller included; with a
+ * single thread that only pays off from 1M points
+ */
+int fft_set_threads(int threads);
+int fft_threads(void);
+
+void *fft_alloc(size_t size);
+void fft_free(void *ptr);
+
+#endif /* FFT_H */
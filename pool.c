@@ -0,0 +1,129 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+struct pool;
+
+struct worker {
+	struct pool *p;
+	int part;
+};
+
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t go;
+	pthread_cond_t done;
+	void (*fn)(void *, int, int);
+	void *arg;
+	unsigned gen;
+	int pending;
+	int quit;
+	int threads;
+	pthread_t tid[POOL_MAX_THREADS];
+	struct worker w[POOL_MAX_THREADS];
+};
+
+static void *pool_thread(void *param)
+{
+	struct worker *w = param;
+	struct pool *p = w->p;
+	unsigned gen = 0;
+
+	pthread_mutex_lock(&p->lock);
+	for ( ;; ) {
+		while (p->gen == gen && !p->quit)
+			pthread_cond_wait(&p->go, &p->lock);
+		if (p->quit)
+			break;
+		gen = p->gen;
+		pthread_mutex_unlock(&p->lock);
+
+		p->fn(p->arg, w->part, p->threads);
+
+		pthread_mutex_lock(&p->lock);
+		if (!--p->pending)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+struct pool *pool_create(int threads)
+{
+	struct pool *p;
+	int i;
+
+	if (threads < 1 || threads > POOL_MAX_THREADS)
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->go, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	for (i = 1; i < threads; i++) {
+		p->w[i].p = p;
+		p->w[i].part = i;
+		if (pthread_create(&p->tid[i], NULL, pool_thread, &p->w[i])) {
+			printf("%s:%d %s()\n", __FILE__, __LINE__, __func__);
+			break;
+		}
+	}
+	p->threads = i;
+	return p;
+}
+
+void pool_destroy(struct pool *p)
+{
+	int i;
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->go);
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 1; i < p->threads; i++)
+		pthread_join(p->tid[i], NULL);
+
+	pthread_cond_destroy(&p->go);
+	pthread_cond_destroy(&p->done);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+int pool_threads(struct pool *p)
+{
+	return p ? p->threads : 1;
+}
+
+void pool_run(struct pool *p, void (*fn)(void *, int, int), void *arg)
+{
+	if (!p || p->threads == 1) {
+		fn(arg, 0, 1);
+		return;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	p->fn = fn;
+	p->arg = arg;
+	p->pending = p->threads - 1;
+	p->gen++;
+	pthread_cond_broadcast(&p->go);
+	pthread_mutex_unlock(&p->lock);
+
+	fn(arg, 0, p->threads);
+
+	pthread_mutex_lock(&p->lock);
+	while (p->pending)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,18 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef POOL_H
+#define POOL_H
+
+#define POOL_MAX_THREADS	32
+
+struct pool;
+
+/* threads counts the caller, which always runs part 0 */
+struct pool *pool_create(int threads);
+void pool_destroy(struct pool *p);
+int pool_threads(struct pool *p);
+
+/* fn(arg, part, parts) for every part, returns when all are done */
+void pool_run(struct pool *p, void (*fn)(void *, int, int), void *arg);
+
+#endif /* POOL_H */
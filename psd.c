@@ -0,0 +1,160 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "fft.h"
+#include "psd.h"
+
+struct psd {
+	int n;
+	int mode;
+	int frames;
+	float decay;
+	unsigned long count;
+	float *avg;
+	float *sum;		/* PSD_BLOCK, the run so far */
+	float *peak;
+	float *avg_db;
+	float *peak_db;
+};
+
+static const char *mode_names[] = {
+	[PSD_EXP]	= "exp",
+	[PSD_BLOCK]	= "block",
+};
+
+int psd_mode(const char *name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++)
+		if (!strcmp(name, mode_names[i]))
+			return i;
+	return -1;
+}
+
+const char *psd_mode_name(int mode)
+{
+	return mode_names[mode];
+}
+
+struct psd *psd_create(int n, int mode, int frames, float decay)
+{
+	struct psd *p;
+
+	if (n <= 0 || mode < PSD_EXP || mode > PSD_BLOCK || frames < 1 ||
+	    decay < 0.0f || decay > 1.0f)
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	p->n = n;
+	p->mode = mode;
+	p->frames = frames;
+	p->decay = decay;
+	p->avg = fft_alloc(sizeof(*p->avg) * n);
+	p->sum = fft_alloc(sizeof(*p->sum) * n);
+	p->peak = fft_alloc(sizeof(*p->peak) * n);
+	p->avg_db = fft_alloc(sizeof(*p->avg_db) * n);
+	p->peak_db = fft_alloc(sizeof(*p->peak_db) * n);
+	if (!p->avg || !p->sum || !p->peak || !p->avg_db || !p->peak_db) {
+		psd_destroy(p);
+		return NULL;
+	}
+	psd_reset(p);
+	return p;
+}
+
+void psd_destroy(struct psd *p)
+{
+	if (!p)
+		return;
+	fft_free(p->avg);
+	fft_free(p->sum);
+	fft_free(p->peak);
+	fft_free(p->avg_db);
+	fft_free(p->peak_db);
+	free(p);
+}
+
+void psd_reset(struct psd *p)
+{
+	memset(p->avg, 0, sizeof(*p->avg) * p->n);
+	memset(p->sum, 0, sizeof(*p->sum) * p->n);
+	memset(p->peak, 0, sizeof(*p->peak) * p->n);
+	p->count = 0;
+}
+
+void psd_update(struct psd *p, const float *pow)
+{
+	unsigned long k = ++p->count;
+	float w;
+
+	if (p->mode == PSD_EXP) {
+		w = 1.0f / (k < p->frames ? k : p->frames);
+		dsp_avg_peak(p->avg, p->peak, pow, p->n, 1.0f - w, w, p->decay);
+		return;
+	}
+
+	/* a run starts from nothing, the last one stays up until it ends */
+	k = (k - 1) % p->frames;
+	dsp_avg_peak(p->sum, p->peak, pow, p->n, k ? 1.0f : 0.0f, 1.0f,
+		     p->decay);
+	if (k == p->frames - 1)
+		dsp_avg_peak(p->avg, NULL, p->sum, p->n, 0.0f,
+			     1.0f / p->frames, 0.0f);
+}
+
+const float *psd_avg(struct psd *p)
+{
+	return p->avg;
+}
+
+const float *psd_peak(struct psd *p)
+{
+	return p->peak;
+}
+
+unsigned long psd_count(struct psd *p)
+{
+	return p->count;
+}
+
+unsigned long psd_avg_count(struct psd *p)
+{
+	if (p->mode == PSD_EXP)
+		return p->count < p->frames ? p->count : p->frames;
+	return p->count - p->count % p->frames;
+}
+
+void psd_db(struct psd *p, float floor, float ceil)
+{
+	dsp_db(p->avg, p->n, p->avg_db, floor, ceil);
+	dsp_db(p->peak, p->n, p->peak_db, floor, ceil);
+}
+
+const float *psd_avg_db(struct psd *p)
+{
+	return p->avg_db;
+}
+
+const float *psd_peak_db(struct psd *p)
+{
+	return p->peak_db;
+}
+
+int psd_print(struct psd *p, FILE *f, const float *last, float hz,
+	      float floor, float ceil)
+{
+	int i;
+
+	psd_db(p, floor, ceil);
+	fprintf(f, "# hz last avg peak\n");
+	for (i = 0; i < p->n; i++)
+		fprintf(f, "%.1f %.2f %.2f %.2f\n", i * hz, last[i],
+			p->avg_db[i], p->peak_db[i]);
+	return fprintf(f, "# end\n") < 0 ? -1 : 0;
+}
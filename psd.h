@@ -0,0 +1,52 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef PSD_H
+#define PSD_H
+
+#include <stdio.h>
+
+enum {
+	PSD_EXP,	/* exponential, 1 / frames weight once warmed up */
+	PSD_BLOCK,	/* Welch, the mean of each run of frames */
+};
+
+struct psd;
+
+/*
+ * Averaged power spectrum and peak hold over n bins, updated in place from
+ * every new power spectrum with one pass and no history.  PSD_EXP weighs
+ * the k-th frame 1 / min(k, frames), an exact mean until frames are in
+ * and an exponential average with that time constant after.  PSD_BLOCK
+ * sums frames and publishes their mean every frames frames.  The peak
+ * hold drops by decay (a power ratio, < 1) per frame until something
+ * louder replaces it.
+ */
+struct psd *psd_create(int n, int mode, int frames, float decay);
+void psd_destroy(struct psd *p);
+
+void psd_update(struct psd *p, const float *pow);
+void psd_reset(struct psd *p);
+
+const float *psd_avg(struct psd *p);
+const float *psd_peak(struct psd *p);
+unsigned long psd_count(struct psd *p);		/* frames since the reset */
+/* frames in the published average, none until PSD_BLOCK ends a run */
+unsigned long psd_avg_count(struct psd *p);
+
+/* both in dB limited to [floor, ceil], see dsp_db() */
+void psd_db(struct psd *p, float floor, float ceil);
+const float *psd_avg_db(struct psd *p);
+const float *psd_peak_db(struct psd *p);
+
+/*
+ * "# hz last avg peak", then a line per bin: its frequency (bin * hz), the
+ * last frame's dB from last[] and the average and peak hold in dB, then
+ * "# end".  Converts with psd_db() first.
+ */
+int psd_print(struct psd *p, FILE *f, const float *last, float hz,
+	      float floor, float ceil);
+
+int psd_mode(const char *name);
+const char *psd_mode_name(int mode);
+
+#endif /* PSD_H */
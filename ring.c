@@ -0,0 +1,96 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "ring.h"
+
+#define CACHE_LINE	64
+
+struct ring {
+	/* producer and consumer indices on their own cache lines */
+	_Alignas(CACHE_LINE) atomic_uint head;	/* next slot to write */
+	_Alignas(CACHE_LINE) atomic_uint tail;	/* next slot to read */
+	_Alignas(CACHE_LINE) unsigned mask;
+	int slot_size;
+	char *buf;
+};
+
+struct ring *ring_create(int slot_size, int slots)
+{
+	struct ring *r;
+	int n;
+
+	for (n = 1; n < slots; n <<= 1)
+		;
+
+	if (posix_memalign((void **)&r, CACHE_LINE, sizeof(*r)))
+		return NULL;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	r->mask = n - 1;
+	r->slot_size = (slot_size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+	if (posix_memalign((void **)&r->buf, CACHE_LINE, (size_t)r->slot_size * n)) {
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+void ring_destroy(struct ring *r)
+{
+	if (!r)
+		return;
+	free(r->buf);
+	free(r);
+}
+
+void *ring_write_slot(struct ring *r)
+{
+	unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+	if (head - tail > r->mask)
+		return NULL;
+	return r->buf + (size_t)(head & r->mask) * r->slot_size;
+}
+
+void ring_write_commit(struct ring *r)
+{
+	unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void *ring_read_slot(struct ring *r)
+{
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+	if (head == tail)
+		return NULL;
+	return r->buf + (size_t)(tail & r->mask) * r->slot_size;
+}
+
+void ring_read_commit(struct ring *r)
+{
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+int ring_count(struct ring *r)
+{
+	return atomic_load_explicit(&r->head, memory_order_acquire) -
+	       atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+int ring_slots(struct ring *r)
+{
+	return r->mask + 1;
+}
+
+int ring_slot_size(struct ring *r)
+{
+	return r->slot_size;
+}
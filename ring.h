@@ -0,0 +1,28 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef RING_H
+#define RING_H
+
+/*
+ * Lock-free single producer / single consumer ring of fixed size slots.
+ * The producer fills ring_write_slot() and publishes it with
+ * ring_write_commit(), the consumer reads ring_read_slot() and releases it
+ * with ring_read_commit(); either side gets NULL when there is nothing to
+ * do and never blocks.
+ */
+struct ring;
+
+struct ring *ring_create(int slot_size, int slots);
+void ring_destroy(struct ring *r);
+
+void *ring_write_slot(struct ring *r);
+void ring_write_commit(struct ring *r);
+
+void *ring_read_slot(struct ring *r);
+void ring_read_commit(struct ring *r);
+
+int ring_count(struct ring *r);
+int ring_slots(struct ring *r);
+int ring_slot_size(struct ring *r);
+
+#endif /* RING_H */
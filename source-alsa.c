@@ -0,0 +1,131 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "source.h"
+
+static int alsa_open(struct source *s, const char *arg,
+		     const struct source_param *p)
+{
+	struct audioparam *ap;
+
+	ap = calloc(1, sizeof(*ap));
+	if (!ap)
+		return -1;
+	if (audio_open(ap, 1, p->rate, p->frames, 1, p->mmap)) {
+		free(ap);
+		return -1;
+	}
+	s->rate = ap->rate;
+	s->frames = ap->frames;
+	s->live = 1;
+	s->priv = ap;
+	return 0;
+}
+
+static void alsa_close(struct source *s)
+{
+	audio_close(s->priv);
+	free(s->priv);
+}
+
+static int alsa_read(struct source *s, int16_t *pcm)
+{
+	int err = audio_read(s->priv, pcm);
+
+	if (err == -EPIPE)
+		s->xruns++;
+	return err ? -1 : 0;
+}
+
+/* switches the pcm to non-blocking, from here on only poll_read is used */
+static int alsa_poll_fds(struct source *s, struct pollfd *pfd, int max)
+{
+	struct audioparam *ap = s->priv;
+	int n;
+
+	n = snd_pcm_poll_descriptors_count(ap->sp);
+	if (n < 1 || n > max) {
+		printf("%s:%d %s() %d\n", __FILE__, __LINE__, __func__, n);
+		return -1;
+	}
+	if (snd_pcm_nonblock(ap->sp, 1) < 0 || snd_pcm_start(ap->sp) < 0)
+		return -1;
+	return snd_pcm_poll_descriptors(ap->sp, pfd, n);
+}
+
+static void alsa_recover(struct source *s, int err)
+{
+	struct audioparam *ap = s->priv;
+
+	if (err == -EPIPE)
+		s->xruns++;
+	if (snd_pcm_state(ap->sp) != SND_PCM_STATE_PREPARED)
+		snd_pcm_prepare(ap->sp);
+	snd_pcm_start(ap->sp);
+}
+
+/*
+ * Every whole period the device has.  With mmap access fn gets the samples
+ * in place between snd_pcm_mmap_begin() and snd_pcm_mmap_commit(), with no
+ * copy and no read syscall; otherwise they are read into ap->buf first.
+ */
+static int alsa_poll_read(struct source *s, struct pollfd *pfd, int n,
+			  source_fn fn, void *arg)
+{
+	struct audioparam *ap = s->priv;
+	const snd_pcm_channel_area_t *area;
+	snd_pcm_uframes_t off, frames;
+	snd_pcm_sframes_t avail;
+	unsigned short revents;
+	const char *p;
+	int err;
+
+	if (snd_pcm_poll_descriptors_revents(ap->sp, pfd, n, &revents) < 0)
+		return -1;
+	if (!(revents & (POLLIN | POLLERR)))
+		return 0;
+
+	for ( ;; ) {
+		avail = snd_pcm_avail_update(ap->sp);
+		if (avail < 0) {
+			alsa_recover(s, avail);
+			return 0;
+		}
+		if (avail < (snd_pcm_sframes_t)ap->frames)
+			return 0;
+
+		if (!ap->mmap) {
+			err = audio_read(ap, (int16_t *)ap->buf);
+			if (err) {
+				alsa_recover(s, err);
+				return 0;
+			}
+			fn(arg, (int16_t *)ap->buf, ap->frames);
+			continue;
+		}
+
+		/* may come back short at the end of the driver's buffer */
+		frames = avail;
+		if (snd_pcm_mmap_begin(ap->sp, &area, &off, &frames) < 0)
+			return -1;
+		p = (const char *)area->addr + area->first / 8 +
+		    off * area->step / 8;
+		fn(arg, (const int16_t *)p, frames);
+		if (snd_pcm_mmap_commit(ap->sp, off, frames) !=
+		    (snd_pcm_sframes_t)frames)
+			return -1;
+	}
+}
+
+const struct source_ops source_alsa = {
+	.name = "alsa",
+	.open = alsa_open,
+	.close = alsa_close,
+	.read = alsa_read,
+	.poll_fds = alsa_poll_fds,
+	.poll_read = alsa_poll_read,
+};
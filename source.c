@@ -0,0 +1,417 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "source.h"
+
+static const struct source_ops *sources[] = {
+	&source_alsa,
+	&source_file,
+	&source_synth,
+};
+
+struct source *source_open(const char *spec, const struct source_param *p)
+{
+	const struct source_ops *ops;
+	const char *arg;
+	struct source *s;
+	size_t len;
+	int i;
+
+	arg = strchr(spec, ':');
+	len = arg ? (size_t)(arg++ - spec) : strlen(spec);
+
+	for (i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+		ops = sources[i];
+		if (strlen(ops->name) == len && !strncmp(spec, ops->name, len))
+			break;
+	}
+	if (i == sizeof(sources) / sizeof(sources[0])) {
+		fprintf(stderr, "unknown source '%s'\n", spec);
+		return NULL;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->ops = ops;
+	s->rate = p->rate;
+	s->frames = p->frames;
+	s->speed = p->speed;
+	if (ops->open(s, arg, p)) {
+		free(s);
+		return NULL;
+	}
+
+	printf("source %s%s%s rate:%u frames:%d", ops->name, arg ? " " : "",
+	       arg ? arg : "", s->rate, s->frames);
+	if (!s->live)
+		printf(s->speed > 0 ? " speed:%gx" : " speed:unpaced", s->speed);
+	printf("\n");
+	return s;
+}
+
+void source_close(struct source *s)
+{
+	if (!s)
+		return;
+	s->ops->close(s);
+	free(s);
+}
+
+const char *source_name(struct source *s)
+{
+	return s->ops->name;
+}
+
+static long long now_ns(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec * 1000000000LL + tp.tv_nsec;
+}
+
+/* sleep until the samples delivered so far are due at speed x real time */
+static void source_pace(struct source *s)
+{
+	struct timespec tp;
+	long long t;
+
+	if (!s->t0_ns)
+		s->t0_ns = now_ns();
+	s->delivered += s->frames;
+
+	t = s->t0_ns + (long long)(s->delivered * 1e9 / (s->rate * s->speed));
+	tp.tv_sec = t / 1000000000LL;
+	tp.tv_nsec = t % 1000000000LL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tp, NULL) == EINTR)
+		;
+}
+
+int source_read(struct source *s, int16_t *pcm)
+{
+	int ret = s->ops->read(s, pcm);
+
+	if (!ret && !s->live && s->speed > 0)
+		source_pace(s);
+	return ret;
+}
+
+int source_can_poll(struct source *s)
+{
+	return s->ops->poll_fds && s->ops->poll_read;
+}
+
+int source_poll_fds(struct source *s, struct pollfd *pfd, int max)
+{
+	return s->ops->poll_fds(s, pfd, max);
+}
+
+int source_poll_read(struct source *s, struct pollfd *pfd, int n,
+		     source_fn fn, void *arg)
+{
+	return s->ops->poll_read(s, pfd, n, fn, arg);
+}
+
+/******************************************************************************/
+
+struct file_src {
+	FILE *f;
+	int channels;
+	long remain;		/* data frames left, -1 for raw */
+	int16_t *buf;
+};
+
+static unsigned le16(const unsigned char *b)
+{
+	return b[0] | b[1] << 8;
+}
+
+static unsigned le32(const unsigned char *b)
+{
+	return le16(b) | le16(b + 2) << 16;
+}
+
+/* leaves f at the start of the sample data */
+static int wav_header(struct source *s, struct file_src *fs, const char *path)
+{
+	unsigned char b[16];
+	unsigned size, fmt = 0, bits = 0;
+
+	if (fread(b, 1, 12, fs->f) != 12 || memcmp(b, "RIFF", 4) ||
+	    memcmp(b + 8, "WAVE", 4))
+		return 0;
+
+	for ( ;; ) {
+		if (fread(b, 1, 8, fs->f) != 8) {
+			fprintf(stderr, "%s: no data chunk\n", path);
+			return -1;
+		}
+		size = le32(b + 4);
+
+		if (!memcmp(b, "data", 4))
+			break;
+
+		if (!memcmp(b, "fmt ", 4) && size >= 16) {
+			if (fread(b, 1, 16, fs->f) != 16)
+				return -1;
+			fmt = le16(b);
+			fs->channels = le16(b + 2);
+			s->rate = le32(b + 4);
+			bits = le16(b + 14);
+			size -= 16;
+		}
+		if (fseek(fs->f, size + (size & 1), SEEK_CUR))
+			return -1;
+	}
+
+	/* 0xfffe is WAVE_FORMAT_EXTENSIBLE, trust the bit depth */
+	if ((fmt != 1 && fmt != 0xfffe) || bits != 16 || !fs->channels ||
+	    !s->rate) {
+		fprintf(stderr, "%s: format %#x %u bits %d channels, need PCM S16\n",
+			path, fmt, bits, fs->channels);
+		return -1;
+	}
+	fs->remain = size / (2 * fs->channels);
+	return 1;
+}
+
+static int file_open(struct source *s, const char *path,
+		     const struct source_param *p)
+{
+	struct file_src *fs;
+	int ret;
+
+	if (!path || !*path) {
+		fprintf(stderr, "file source needs a path\n");
+		return -1;
+	}
+
+	fs = calloc(1, sizeof(*fs));
+	if (!fs)
+		return -1;
+	fs->f = fopen(path, "rb");
+	if (!fs->f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		free(fs);
+		return -1;
+	}
+
+	ret = wav_header(s, fs, path);
+	if (ret < 0)
+		goto err;
+	if (!ret) {
+		/* raw mono S16_LE at the requested rate */
+		rewind(fs->f);
+		fs->channels = 1;
+		fs->remain = -1;
+	}
+
+	/* keep the period duration when the file has its own rate */
+	s->frames = (long long)p->frames * s->rate / p->rate;
+	if (s->frames < 1)
+		s->frames = 1;
+
+	fs->buf = malloc(sizeof(*fs->buf) * s->frames * fs->channels);
+	if (!fs->buf)
+		goto err;
+	s->priv = fs;
+	return 0;
+err:
+	fclose(fs->f);
+	free(fs);
+	return -1;
+}
+
+static void file_close(struct source *s)
+{
+	struct file_src *fs = s->priv;
+
+	fclose(fs->f);
+	free(fs->buf);
+	free(fs);
+}
+
+static int file_read(struct source *s, int16_t *pcm)
+{
+	struct file_src *fs = s->priv;
+	int16_t *b = fs->buf;
+	long want = s->frames;
+	int i, c, n, sum;
+
+	if (fs->remain >= 0 && fs->remain < want)
+		want = fs->remain;
+	n = want ? fread(b, 2 * fs->channels, want, fs->f) : 0;
+	if (!n)
+		return 1;
+	if (fs->remain >= 0)
+		fs->remain -= n;
+
+	for (i = 0; i < n; i++) {
+		for (sum = 0, c = 0; c < fs->channels; c++) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			sum += (int16_t)__builtin_bswap16(b[i * fs->channels + c]);
+#else
+			sum += b[i * fs->channels + c];
+#endif
+		}
+		pcm[i] = sum / fs->channels;
+	}
+	/* the short last period is padded with silence */
+	memset(&pcm[n], 0, sizeof(*pcm) * (s->frames - n));
+	return 0;
+}
+
+const struct source_ops source_file = {
+	.name = "file",
+	.open = file_open,
+	.close = file_close,
+	.read = file_read,
+};
+
+/******************************************************************************/
+
+#define SYNTH_PARTS		8
+#define SYNTH_CHIRP_SECS	4
+#define SYNTH_DEFAULT		"sine=1000*0.3,chirp=100-10000*0.2,noise=0.01"
+
+enum {
+	SYNTH_SINE,
+	SYNTH_CHIRP,
+	SYNTH_NOISE,
+};
+
+struct synth_part {
+	int kind;
+	double f0, f1;
+	double amp;
+	double phase;
+};
+
+struct synth_src {
+	struct synth_part part[SYNTH_PARTS];
+	int parts;
+	unsigned long long n;	/* samples generated */
+	uint32_t seed;
+};
+
+static int synth_parse(struct synth_src *ss, char *spec)
+{
+	struct synth_part *p;
+	char *tok, *save, *e;
+
+	for (tok = strtok_r(spec, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		if (ss->parts == SYNTH_PARTS)
+			return -1;
+		p = &ss->part[ss->parts++];
+		p->amp = 0.5;
+
+		if (!strncmp(tok, "sine=", 5)) {
+			p->kind = SYNTH_SINE;
+			p->f0 = strtod(tok + 5, &e);
+		} else if (!strncmp(tok, "chirp=", 6)) {
+			p->kind = SYNTH_CHIRP;
+			p->f0 = strtod(tok + 6, &e);
+			if (*e++ != '-')
+				return -1;
+			p->f1 = strtod(e, &e);
+		} else if (!strncmp(tok, "noise=", 6)) {
+			p->kind = SYNTH_NOISE;
+			p->amp = strtod(tok + 6, &e);
+		} else {
+			return -1;
+		}
+
+		if (*e == '*' && p->kind != SYNTH_NOISE)
+			p->amp = strtod(e + 1, &e);
+		if (*e)
+			return -1;
+	}
+	return ss->parts ? 0 : -1;
+}
+
+static int synth_open(struct source *s, const char *arg,
+		      const struct source_param *p)
+{
+	struct synth_src *ss;
+	char *spec;
+	int ret;
+
+	ss = calloc(1, sizeof(*ss));
+	spec = strdup(arg && *arg ? arg : SYNTH_DEFAULT);
+	if (!ss || !spec) {
+		free(ss);
+		free(spec);
+		return -1;
+	}
+	ret = synth_parse(ss, spec);
+	free(spec);
+	if (ret) {
+		fprintf(stderr, "bad synth spec '%s'\n", arg);
+		free(ss);
+		return -1;
+	}
+	ss->seed = 0x12345678;
+	s->priv = ss;
+	return 0;
+}
+
+static void synth_close(struct source *s)
+{
+	free(s->priv);
+}
+
+static int synth_read(struct source *s, int16_t *pcm)
+{
+	struct synth_src *ss = s->priv;
+	unsigned long long sweep = (unsigned long long)SYNTH_CHIRP_SECS * s->rate;
+	struct synth_part *p;
+	double v, f;
+	uint32_t x;
+	int i, j;
+
+	for (i = 0; i < s->frames; i++, ss->n++) {
+		for (v = 0, j = 0; j < ss->parts; j++) {
+			p = &ss->part[j];
+			switch (p->kind) {
+			case SYNTH_SINE:
+			case SYNTH_CHIRP:
+				f = p->f0;
+				if (p->kind == SYNTH_CHIRP)
+					f += (p->f1 - p->f0) *
+					     (ss->n % sweep) / sweep;
+				v += p->amp * sin(p->phase);
+				p->phase += 2 * M_PI * f / s->rate;
+				if (p->phase > 2 * M_PI)
+					p->phase -= 2 * M_PI;
+				break;
+			case SYNTH_NOISE:
+				/* xorshift32, same sequence every run */
+				x = ss->seed;
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				ss->seed = x;
+				v += p->amp * ((double)x / 2147483648.0 - 1.0);
+				break;
+			}
+		}
+		v *= 32767;
+		pcm[i] = v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v;
+	}
+	return 0;
+}
+
+const struct source_ops source_synth = {
+	.name = "synth",
+	.open = synth_open,
+	.close = synth_close,
+	.read = synth_read,
+};
@@ -0,0 +1,77 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Mono S16 input delivered one period at a time.  A spec names the backend
+ * and its argument:
+ *
+ *   alsa                  the "default" capture device
+ *   file:<path>           a WAV (PCM S16, any channel count, downmixed) or
+ *                         raw mono S16_LE file at the requested rate
+ *   synth[:<parts>]       deterministic test signal, parts separated by ','
+ *                         sine=<hz>[*<amp>], chirp=<hz>-<hz>[*<amp>],
+ *                         noise=<amp>; amplitudes are 0..1 of full scale
+ *
+ * Files and synth are paced to speed times real time, speed 0 delivers as
+ * fast as the reader takes them.
+ */
+struct source_param {
+	unsigned                rate;		/* requested, a file may differ */
+	int                     frames;		/* period, at the requested rate */
+	float                   speed;
+	int                     mmap;		/* alsa mmap access */
+};
+
+struct source;
+
+/* fn receives samples from a polled read, possibly less than a period */
+typedef void (*source_fn)(void *arg, const int16_t *pcm, int frames);
+
+struct source_ops {
+	const char *name;
+	int (*open)(struct source *s, const char *arg,
+		    const struct source_param *p);
+	void (*close)(struct source *s);
+	/* blocking, one period: 0, 1 at end of input, < 0 on a lost period */
+	int (*read)(struct source *s, int16_t *pcm);
+	/* optional non-blocking reads from the caller's poll loop */
+	int (*poll_fds)(struct source *s, struct pollfd *pfd, int max);
+	int (*poll_read)(struct source *s, struct pollfd *pfd, int n,
+			 source_fn fn, void *arg);
+};
+
+struct source {
+	const struct source_ops *ops;
+	unsigned                rate;
+	int                     frames;
+	int                     live;		/* device clocked, can overrun */
+	atomic_ulong            xruns;
+	void                    *priv;
+
+	/* pacing */
+	float                   speed;
+	unsigned long long      delivered;
+	long long               t0_ns;
+};
+
+struct source *source_open(const char *spec, const struct source_param *p);
+void source_close(struct source *s);
+const char *source_name(struct source *s);
+
+int source_read(struct source *s, int16_t *pcm);
+int source_can_poll(struct source *s);
+int source_poll_fds(struct source *s, struct pollfd *pfd, int max);
+int source_poll_read(struct source *s, struct pollfd *pfd, int n,
+		     source_fn fn, void *arg);
+
+extern const struct source_ops source_alsa;
+extern const struct source_ops source_file;
+extern const struct source_ops source_synth;
+
+#endif /* SOURCE_H */
@@ -0,0 +1,271 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "stft.h"
+
+/* samples of backlog the ring keeps on top of one frame */
+#define STFT_BACKLOG	8192
+
+/* per frame weight of the frame mean in the running dc estimate */
+#define STFT_DC_ALPHA	0.1f
+
+#define STFT_DB_FLOOR	-120.0f
+#define STFT_DB_CEIL	0.0f
+
+struct stft {
+	int size;
+	int hop;
+	int window;
+	struct fft_plan *plan;
+	float *win;
+	float *norm;		/* per bin, window gain and one sided scaling */
+	float *pow;
+	float *db;
+	float floor, ceil;
+
+	int16_t *ring;		/* cap samples, the first size mirrored after */
+	int cap;		/* power of two */
+	unsigned long long head;	/* samples pushed */
+	unsigned long long next;	/* start of the next frame */
+	unsigned long dropped;
+	float dc;
+};
+
+static const char *win_names[] = {
+	[WIN_RECT]	= "rect",
+	[WIN_HANN]	= "hann",
+	[WIN_HAMMING]	= "hamming",
+	[WIN_BLACKMAN]	= "blackman",
+};
+
+int stft_window(const char *name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(win_names) / sizeof(win_names[0]); i++)
+		if (!strcmp(name, win_names[i]))
+			return i;
+	return -1;
+}
+
+const char *stft_window_name(int window)
+{
+	return win_names[window];
+}
+
+static void window_init(float *w, int n, int window)
+{
+	double a;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		a = 2 * M_PI * i / n;
+		switch (window) {
+		case WIN_HANN:
+			w[i] = 0.5 - 0.5 * cos(a);
+			break;
+		case WIN_HAMMING:
+			w[i] = 0.54 - 0.46 * cos(a);
+			break;
+		case WIN_BLACKMAN:
+			w[i] = 0.42 - 0.5 * cos(a) + 0.08 * cos(2 * a);
+			break;
+		default:
+			w[i] = 1.0f;
+			break;
+		}
+	}
+}
+
+/*
+ * A sine of amplitude a puts a * sum(w) / 2 in its bin, so (2 / sum(w))^2
+ * turns |X|^2 into a^2: 0 dB for full scale whatever the window.  dc and
+ * Nyquist have no negative frequency twin and lose the 2.
+ */
+static void norm_init(float *norm, const float *w, int n)
+{
+	double sum = 0.0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += w[i];
+	for (i = 0; i < n / 2 + 1; i++)
+		norm[i] = 4.0 / (sum * sum);
+	norm[0] /= 4;
+	norm[n / 2] /= 4;
+}
+
+struct stft *stft_create(int fft_size, int hop, int window)
+{
+	struct stft *s;
+	int i, bins = fft_size / 2 + 1;
+
+	if (fft_size < 2 || hop < 1 || window < WIN_RECT || window > WIN_BLACKMAN) {
+		fprintf(stderr, "%s: bad size %d hop %d window %d\n", __func__,
+			fft_size, hop, window);
+		return NULL;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->size = fft_size;
+	s->hop = hop;
+	s->window = window;
+	s->floor = STFT_DB_FLOOR;
+	s->ceil = STFT_DB_CEIL;
+
+	for (s->cap = 1; s->cap < fft_size + hop + STFT_BACKLOG; s->cap <<= 1)
+		;
+
+	s->plan = fft_plan_create(fft_size, FFT_REAL);
+	s->win = fft_alloc(sizeof(*s->win) * fft_size);
+	s->norm = fft_alloc(sizeof(*s->norm) * bins);
+	s->pow = fft_alloc(sizeof(*s->pow) * bins);
+	s->db = fft_alloc(sizeof(*s->db) * bins);
+	s->ring = fft_alloc(sizeof(*s->ring) * (s->cap + fft_size));
+	if (!s->plan || !s->win || !s->norm || !s->pow || !s->db || !s->ring) {
+		stft_destroy(s);
+		return NULL;
+	}
+	memset(s->ring, 0, sizeof(*s->ring) * (s->cap + fft_size));
+	memset(s->pow, 0, sizeof(*s->pow) * bins);
+	for (i = 0; i < bins; i++)
+		s->db[i] = s->floor;
+	window_init(s->win, fft_size, window);
+	norm_init(s->norm, s->win, fft_size);
+	return s;
+}
+
+void stft_destroy(struct stft *s)
+{
+	if (!s)
+		return;
+	fft_plan_destroy(s->plan);
+	fft_free(s->win);
+	fft_free(s->norm);
+	fft_free(s->pow);
+	fft_free(s->db);
+	fft_free(s->ring);
+	free(s);
+}
+
+void stft_push(struct stft *s, const int16_t *pcm, int frames)
+{
+	int pos, n;
+
+	while (frames) {
+		pos = s->head & (s->cap - 1);
+		n = frames < s->cap - pos ? frames : s->cap - pos;
+
+		memcpy(&s->ring[pos], pcm, sizeof(*pcm) * n);
+		if (pos < s->size)
+			memcpy(&s->ring[s->cap + pos], pcm,
+			       sizeof(*pcm) * (n < s->size - pos ? n : s->size - pos));
+
+		s->head += n;
+		pcm += n;
+		frames -= n;
+	}
+
+	/* frames whose start has been overwritten are skipped */
+	while (s->head - s->next > s->cap) {
+		s->next += s->hop;
+		s->dropped++;
+	}
+}
+
+int stft_next(struct stft *s)
+{
+	const int16_t *x;
+	complex *c;
+	float sum;
+
+	if (s->head - s->next < s->size)
+		return 0;
+
+	x = &s->ring[s->next & (s->cap - 1)];
+	s->next += s->hop;
+
+	/* convert, remove dc and window straight into the transform input */
+	c = fft_plan_work(s->plan);
+	sum = dsp_s16_window((float *)c, x, s->win, s->size, 1.0f / 32768, s->dc);
+	s->dc += STFT_DC_ALPHA * (sum / s->size - s->dc);
+	fft_execute(s->plan, c);
+
+	dsp_power_db((const float *)c, s->norm, s->size / 2 + 1, s->pow, s->db,
+		     s->floor, s->ceil);
+	return 1;
+}
+
+int stft_size(struct stft *s)
+{
+	return s->size;
+}
+
+int stft_hop(struct stft *s)
+{
+	return s->hop;
+}
+
+int stft_window_of(struct stft *s)
+{
+	return s->window;
+}
+
+int stft_bins(struct stft *s)
+{
+	return s->size / 2 + 1;
+}
+
+const complex *stft_spectrum(struct stft *s)
+{
+	return fft_plan_work(s->plan);
+}
+
+const float *stft_power(struct stft *s)
+{
+	return s->pow;
+}
+
+const float *stft_db(struct stft *s)
+{
+	return s->db;
+}
+
+int stft_db_range(struct stft *s, float floor, float ceil)
+{
+	/* the floor as a power must stay a normal float */
+	if (floor < STFT_DB_MIN || ceil <= floor)
+		return -1;
+	s->floor = floor;
+	s->ceil = ceil;
+	return 0;
+}
+
+float stft_db_floor(struct stft *s)
+{
+	return s->floor;
+}
+
+float stft_db_ceil(struct stft *s)
+{
+	return s->ceil;
+}
+
+unsigned long stft_dropped(struct stft *s)
+{
+	return s->dropped;
+}
+
+const int16_t *stft_history(struct stft *s, int n)
+{
+	if (n > s->size)
+		n = s->size;
+	return &s->ring[(s->head - n) & (s->cap - 1)];
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef STFT_H
+#define STFT_H
+
+#include <stdint.h>
+
+#include "fft.h"
+
+enum {
+	WIN_RECT,
+	WIN_HANN,
+	WIN_HAMMING,
+	WIN_BLACKMAN,
+};
+
+struct stft;
+
+/* lowest usable dB floor */
+#define STFT_DB_MIN	-300
+
+/*
+ * Short-time transform of a mono S16 stream: frames of fft_size samples,
+ * one every hop samples (hop < fft_size overlaps them), weighted by the
+ * window.  Pushed samples go into a ring whose head is mirrored past its
+ * end, so every frame is a contiguous view and no history is copied.
+ */
+struct stft *stft_create(int fft_size, int hop, int window);
+void stft_destroy(struct stft *s);
+
+void stft_push(struct stft *s, const int16_t *pcm, int frames);
+
+/* transforms the next complete frame, 0 when there is none */
+int stft_next(struct stft *s);
+
+int stft_size(struct stft *s);
+int stft_hop(struct stft *s);
+int stft_window_of(struct stft *s);	/* WIN_* */
+int stft_bins(struct stft *s);		/* fft_size / 2 + 1 */
+const complex *stft_spectrum(struct stft *s);
+
+/*
+ * Power per bin of the last frame, normalized so a full scale sine reads
+ * 1.0 whatever the window, and the same in dB limited to the range set by
+ * stft_db_range(), -120 to 0 dB unless changed.
+ */
+const float *stft_power(struct stft *s);
+const float *stft_db(struct stft *s);
+int stft_db_range(struct stft *s, float floor, float ceil);
+float stft_db_floor(struct stft *s);
+float stft_db_ceil(struct stft *s);
+
+unsigned long stft_dropped(struct stft *s);	/* frames overwritten unread */
+
+/* the last n <= fft_size samples pushed, contiguous */
+const int16_t *stft_history(struct stft *s, int n);
+
+int stft_window(const char *name);
+const char *stft_window_name(int window);
+
+#endif /* STFT_H */
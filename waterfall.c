@@ -0,0 +1,106 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "dsp.h"
+#include "waterfall.h"
+
+/* the colormap spans this far below the peak */
+#define WF_RANGE_DB	80.0f
+/* dB per column, about 7 s for -60dB at 86 columns / s */
+#define WF_PEAK_DECAY	0.1f
+
+/* black - purple - red - orange - pale yellow, like inferno */
+static const uint8_t wf_stops[][3] = {
+	{   0,   0,   4 },
+	{  87,  16, 110 },
+	{ 188,  55,  84 },
+	{ 249, 142,   9 },
+	{ 252, 255, 164 },
+};
+
+static void lut_init(uint32_t *lut, int n)
+{
+	int s = sizeof(wf_stops) / sizeof(wf_stops[0]) - 1;
+	float t, f;
+	int i, k, c, v[3];
+
+	for (i = 0; i < n; i++) {
+		t = (float)i * s / (n - 1);
+		k = t < s ? (int)t : s - 1;
+		f = t - k;
+		for (c = 0; c < 3; c++)
+			v[c] = wf_stops[k][c] +
+			       f * (wf_stops[k + 1][c] - wf_stops[k][c]) + 0.5f;
+		lut[i] = v[0] << 16 | v[1] << 8 | v[2];
+	}
+}
+
+struct waterfall *waterfall_create(int width, int height, int first, int n)
+{
+	struct waterfall *wf;
+	size_t i;
+	int r;
+
+	if (width <= 0 || height <= 0 || n <= 0)
+		return NULL;
+
+	wf = calloc(1, sizeof(*wf));
+	if (!wf)
+		return NULL;
+	wf->width = width;
+	wf->height = height;
+	wf->peak = -INFINITY;
+	wf->px = malloc(sizeof(*wf->px) * width * height);
+	wf->lo = malloc(sizeof(*wf->lo) * height);
+	wf->hi = malloc(sizeof(*wf->hi) * height);
+	wf->row = malloc(sizeof(*wf->row) * height);
+	if (!wf->px || !wf->lo || !wf->hi || !wf->row) {
+		waterfall_destroy(wf);
+		return NULL;
+	}
+
+	lut_init(wf->lut, sizeof(wf->lut) / sizeof(wf->lut[0]));
+	for (i = 0; i < (size_t)width * height; i++)
+		wf->px[i] = wf->lut[0];
+
+	/* row 0 is the top, the highest bins */
+	for (r = 0; r < height; r++) {
+		wf->lo[r] = first + (long long)(height - 1 - r) * n / height;
+		wf->hi[r] = first + (long long)(height - r) * n / height;
+		if (wf->hi[r] <= wf->lo[r])
+			wf->hi[r] = wf->lo[r] + 1;
+	}
+	return wf;
+}
+
+void waterfall_destroy(struct waterfall *wf)
+{
+	if (!wf)
+		return;
+	free(wf->px);
+	free(wf->lo);
+	free(wf->hi);
+	free(wf->row);
+	free(wf);
+}
+
+void waterfall_column(struct waterfall *wf, const float *db)
+{
+	const int last = sizeof(wf->lut) / sizeof(wf->lut[0]) - 1;
+	const float scale = last / WF_RANGE_DB;
+	uint32_t *p = wf->px + wf->pos;
+	float top;
+	int r, i;
+
+	top = dsp_max_ranges(db, wf->lo, wf->hi, wf->height, wf->row);
+	wf->peak = fmaxf(top, wf->peak - WF_PEAK_DECAY);
+	for (r = 0; r < wf->height; r++, p += wf->width) {
+		i = last + (int)(scale * (wf->row[r] - wf->peak));
+		*p = wf->lut[i < 0 ? 0 : i];
+	}
+
+	if (++wf->pos == wf->width)
+		wf->pos = 0;
+}
@@ -0,0 +1,34 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef WATERFALL_H
+#define WATERFALL_H
+
+#include <stdint.h>
+
+/*
+ * Spectrogram kept as a circular width x height image of 0x00RRGGBB
+ * pixels: every spectrum becomes exactly one column, written at pos, and
+ * nothing already in the image is touched again.  The oldest column is at
+ * pos, so a view is the two pieces [pos, width) and [0, pos) side by side.
+ * Rows are frequency, bins [first, first + n) spread over them with the
+ * highest at the top, each row the loudest of its bins.  Columns are
+ * made from spectra in dB.
+ */
+struct waterfall {
+	int width;
+	int height;
+	int pos;
+	uint32_t *px;
+	int *lo;		/* row -> bins [lo, hi) */
+	int *hi;
+	float *row;		/* the loudest of each row's bins */
+	float peak;		/* slowly decaying reference for the scale, dB */
+	uint32_t lut[256];	/* colormap, quiet to loud */
+};
+
+struct waterfall *waterfall_create(int width, int height, int first, int n);
+void waterfall_destroy(struct waterfall *wf);
+
+void waterfall_column(struct waterfall *wf, const float *db);
+
+#endif /* WATERFALL_H */
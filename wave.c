@@ -0,0 +1,272 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "wave.h"
+
+#define MIN(x, y)	(((x) < (y)) ? (x) : (y))
+#define MAX(x, y)	(((x) > (y)) ? (x) : (y))
+
+#define WAVE_LEVELS	12
+/* the top level still has this many blocks, coarser is no use on screen */
+#define WAVE_TOP_BLOCKS	64
+
+struct wave_level {
+	int block;		/* samples per entry */
+	int n;			/* entries, cap / block */
+	unsigned long long done;	/* entries summarised */
+	int16_t *min;
+	int16_t *max;
+	float *sq;		/* sum of squares */
+};
+
+/*
+ * cap is a multiple of every block size, so the ring and all the levels
+ * wrap together: entry i of a level covers ring samples i * block onwards.
+ */
+struct wave {
+	int cap;
+	int16_t *x;
+	unsigned long long head;	/* samples pushed */
+	int levels;
+	struct wave_level lv[WAVE_LEVELS];
+};
+
+struct wave *wave_create(int max_len)
+{
+	struct wave_level *l;
+	struct wave *w;
+	int block, i;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+
+	for (block = WAVE_BLOCK; block <= max_len / WAVE_TOP_BLOCKS &&
+	     w->levels < WAVE_LEVELS; block *= WAVE_FANOUT)
+		w->lv[w->levels++].block = block;
+
+	/* round up to whole top level blocks */
+	block = w->levels ? w->lv[w->levels - 1].block : 1;
+	w->cap = (MAX(max_len, 1) + block - 1) / block * block;
+	w->x = malloc(sizeof(*w->x) * w->cap);
+	if (!w->x)
+		goto err;
+
+	for (i = 0; i < w->levels; i++) {
+		l = &w->lv[i];
+		l->n = w->cap / l->block;
+		l->min = malloc(sizeof(*l->min) * l->n);
+		l->max = malloc(sizeof(*l->max) * l->n);
+		l->sq = malloc(sizeof(*l->sq) * l->n);
+		if (!l->min || !l->max || !l->sq)
+			goto err;
+	}
+	return w;
+err:
+	wave_destroy(w);
+	return NULL;
+}
+
+void wave_destroy(struct wave *w)
+{
+	int i;
+
+	if (!w)
+		return;
+	for (i = 0; i < w->levels; i++) {
+		free(w->lv[i].min);
+		free(w->lv[i].max);
+		free(w->lv[i].sq);
+	}
+	free(w->x);
+	free(w);
+}
+
+unsigned long long wave_head(struct wave *w)
+{
+	return w->head;
+}
+
+unsigned long long wave_oldest(struct wave *w)
+{
+	return w->head > w->cap ? w->head - w->cap : 0;
+}
+
+int wave_size(struct wave *w)
+{
+	return w->cap;
+}
+
+size_t wave_bytes(struct wave *w)
+{
+	size_t n = sizeof(*w) + sizeof(*w->x) * w->cap;
+	int i;
+
+	for (i = 0; i < w->levels; i++)
+		n += (sizeof(*w->lv[i].min) + sizeof(*w->lv[i].max) +
+		      sizeof(*w->lv[i].sq)) * w->lv[i].n;
+	return n;
+}
+
+/* entry i of dst from WAVE_FANOUT entries from j of src, plain C will do */
+static void wave_fold(struct wave_level *dst, int i,
+		      const struct wave_level *src, int j)
+{
+	int16_t lo = src->min[j], hi = src->max[j];
+	float sq = 0.0f;
+	int k;
+
+	for (k = j; k < j + WAVE_FANOUT; k++) {
+		lo = MIN(src->min[k], lo);
+		hi = MAX(src->max[k], hi);
+		sq += src->sq[k];
+	}
+	dst->min[i] = lo;
+	dst->max[i] = hi;
+	dst->sq[i] = sq;
+}
+
+/* summarise every block completed since the last call, level by level */
+static void wave_summarise(struct wave *w)
+{
+	struct wave_level *l, *s;
+	unsigned long long end;
+	int i, j, k;
+
+	if (!w->levels)
+		return;
+
+	/* whole runs of blocks up to the wrap in one pass */
+	l = &w->lv[0];
+	end = w->head / l->block;
+	if (end - l->done > l->n)
+		l->done = end - l->n;
+	while (l->done < end) {
+		i = l->done % l->n;
+		k = MIN(end - l->done, l->n - i);
+		dsp_s16_minmax(w->x + i * l->block, k * l->block, l->block,
+			       l->min + i, l->max + i, l->sq + i);
+		l->done += k;
+	}
+
+	for (j = 1; j < w->levels; j++) {
+		l = &w->lv[j];
+		s = &w->lv[j - 1];
+		end = s->done / WAVE_FANOUT;
+		if (end - l->done > l->n)
+			l->done = end - l->n;
+		for (; l->done < end; l->done++) {
+			i = l->done % l->n;
+			wave_fold(l, i, s, i * WAVE_FANOUT);
+		}
+	}
+}
+
+void wave_push(struct wave *w, const int16_t *pcm, int n)
+{
+	int pos, k;
+
+	while (n > 0) {
+		pos = w->head % w->cap;
+		k = MIN(n, w->cap - pos);
+		memcpy(w->x + pos, pcm, sizeof(*pcm) * k);
+		w->head += k;
+		pcm += k;
+		n -= k;
+	}
+	wave_summarise(w);
+}
+
+static void span_raw(struct wave *w, struct wave_span *s, float *sq,
+		     unsigned long long a, unsigned long long b)
+{
+	int i = a % w->cap;
+	int16_t v;
+
+	for (; a < b; a++) {
+		v = w->x[i];
+		s->min = MIN(v, s->min);
+		s->max = MAX(v, s->max);
+		*sq += (float)v * v;
+		if (++i == w->cap)
+			i = 0;
+	}
+}
+
+static void span_level(const struct wave_level *l, struct wave_span *s,
+		       float *sq, unsigned long long a, unsigned long long b)
+{
+	int i = a % l->n;
+
+	for (; a < b; a++) {
+		s->min = MIN(l->min[i], s->min);
+		s->max = MAX(l->max[i], s->max);
+		*sq += l->sq[i];
+		if (++i == l->n)
+			i = 0;
+	}
+}
+
+/*
+ * A block belongs to the column its first sample falls in; the first column
+ * also scans the part of the view before its first block, the last column
+ * and any column past the last block summarised scan what is left raw.
+ */
+int wave_columns(struct wave *w, unsigned long long start, int len,
+		 struct wave_span *out, int cols)
+{
+	const struct wave_level *l = NULL;
+	unsigned long long a, b, h, ka, kb, end = 0;
+	int c, i, bk = 1, cnt;
+	float sq;
+
+	if (cols <= 0 || len <= 0 || start < wave_oldest(w) ||
+	    start + len > w->head)
+		return -1;
+
+	/* the coarsest level with at least one block per column */
+	for (i = 0; i < w->levels && w->lv[i].block * (long long)cols <= len;
+	     i++) {
+		l = &w->lv[i];
+		bk = l->block;
+		end = l->done;
+	}
+
+	for (c = 0; c < cols; c++) {
+		a = start + (long long)c * len / cols;
+		b = start + (long long)(c + 1) * len / cols;
+		out[c] = (struct wave_span){ INT16_MAX, INT16_MIN, 0.0f };
+		sq = 0.0f;
+
+		if (!l) {
+			/* zoomed in past one sample per column, repeat it */
+			b = MAX(b, a + 1);
+			span_raw(w, &out[c], &sq, a, b);
+			out[c].rms = sqrtf(sq / (b - a));
+			continue;
+		}
+
+		/* the last column stops at its last whole block */
+		ka = MIN((a + bk - 1) / bk, end);
+		kb = MIN(c == cols - 1 ? b / bk : (b + bk - 1) / bk, end);
+		kb = MAX(kb, ka);
+		cnt = (kb - ka) * bk;
+		if (!c) {
+			h = MAX(MIN(ka * bk, b), a);
+			span_raw(w, &out[c], &sq, a, h);
+			cnt += h - a;
+		}
+		span_level(l, &out[c], &sq, ka, kb);
+		h = MAX(kb * bk, a);
+		if (b > h) {
+			span_raw(w, &out[c], &sq, h, b);
+			cnt += b - h;
+		}
+		out[c].rms = cnt ? sqrtf(sq / cnt) : 0.0f;
+	}
+	return 0;
+}
@@ -0,0 +1,50 @@
+/* Copyright (C) 2020 David Brunecz. Subject to GPL 2.0 */
+
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* level 0 summarises this many samples, each level above WAVE_FANOUT more */
+#define WAVE_BLOCK	16
+#define WAVE_FANOUT	4
+
+struct wave;
+
+/* what a screen column covers: its extremes and its rms */
+struct wave_span {
+	int16_t min;
+	int16_t max;
+	float rms;
+};
+
+/*
+ * Bounded history of a mono S16 stream with a min/max/RMS decimation
+ * pyramid over it.  Samples go into a ring of about max_len, level 0
+ * summarises blocks of WAVE_BLOCK samples with one vector pass as they
+ * complete, every level above folds WAVE_FANOUT blocks of the one below.
+ * A column is answered from the coarsest level whose blocks still fit in
+ * it, so any view costs about the same, proportional to its columns.
+ * Memory is fixed at create time, wave_bytes() tells how much.
+ */
+struct wave *wave_create(int max_len);
+void wave_destroy(struct wave *w);
+
+void wave_push(struct wave *w, const int16_t *pcm, int n);
+
+/* positions count samples pushed, the ring holds [oldest, head) */
+unsigned long long wave_head(struct wave *w);
+unsigned long long wave_oldest(struct wave *w);
+int wave_size(struct wave *w);
+size_t wave_bytes(struct wave *w);
+
+/*
+ * cols spans covering samples [start, start + len), every sample in
+ * exactly one of them.  Column edges snap to the blocks of the level used,
+ * so they may move by less than a column.
+ */
+int wave_columns(struct wave *w, unsigned long long start, int len,
+		 struct wave_span *out, int cols);
+
+#endif /* WAVE_H */